@@ -4,16 +4,126 @@
 #define PATH_TRACER
 
 #include "opengl-wrapper/FrameBufferObject.h"
+#include "opengl-wrapper/GpuProfiler.h"
 #include "opengl-wrapper/Shader.h"
 #include "opengl-wrapper/VertexArrayObjectForMesh.h"
 #include "opengl-wrapper/Window.h"
 #include "core/common.h"
+#include "core/Image.h"
+#include "core/Timer.h"
 #include "imgui/imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
 #include "opengl-wrapper/XYZ_Axis.h"
+#include "opengl-wrapper/TextureBuffer.h"
+#include "opengl-wrapper/TimerQuery.h"
+#include "pathtracer/Checkpoint.h"
+#include "pathtracer/ConvergenceMap.h"
+#include "pathtracer/Denoiser.h"
+#include "pathtracer/PartialAccumulation.h"
+#include "pathtracer/QualityLog.h"
+#include "pathtracer/Sampler.h"
+#include "pathtracer/Scene.h"
+#include "pathtracer/SamplesPerPassTuner.h"
 #include "stb/stb_image_write.h"
 
+// GPU render targets of one accumulation, see render.frag for their layout.
+struct AccumulationTargets {
+    int width, height;
+    Texture2D color;
+    Texture2D moments;
+    Texture2D albedo;
+    Texture2D normal;
+    ConvergenceMap convergenceMap;
+    Texture2D convergence;
+
+    AccumulationTargets(int width, int height, int tileSize, float threshold)
+            : width(width), height(height),
+              color(width, height, GL_RGBA32F, GL_RGBA),
+              moments(width, height, GL_RGBA32F, GL_RGBA),
+              albedo(width, height, GL_RGBA32F, GL_RGBA),
+              normal(width, height, GL_RGBA32F, GL_RGBA),
+              convergenceMap(width, height, tileSize, threshold),
+              convergence(convergenceMap.tilesX, convergenceMap.tilesY, GL_R8, GL_RED, GL_TEXTURE1) {
+        convergence.setTexture(convergenceMap.converged.data(), GL_RED, GL_UNSIGNED_BYTE);
+    }
+
+    // Reads the luminance moments back and stops sampling tiles that have converged.
+    // Returns true once every tile has converged.
+    bool updateConvergence() {
+        if (!convergenceMap.enabled()) {
+            return false;
+        }
+        if (convergenceMap.update(read(moments)) > 0) {
+            convergence.setTexture(convergenceMap.converged.data(), GL_RED, GL_UNSIGNED_BYTE);
+            convergence.release();
+        }
+        return convergenceMap.allConverged();
+    }
+
+    // Averaged radiance, bottom row first.
+    vector<glm::vec3> image() {
+        return average(color);
+    }
+
+    // Needs the AOVs, i.e. passes traced with writeAovs set.
+    DenoiserInput denoiserInput() {
+        return DenoiserInput{width, height, average(color), read(moments), average(albedo), average(normal)};
+    }
+
+    Checkpoint checkpoint() {
+        Checkpoint checkpoint;
+        checkpoint.width = width;
+        checkpoint.height = height;
+        checkpoint.tilesX = convergenceMap.tilesX;
+        checkpoint.tilesY = convergenceMap.tilesY;
+        checkpoint.accumulation = read(color);
+        checkpoint.moments = read(moments);
+        checkpoint.albedo = read(albedo);
+        checkpoint.normals = read(normal);
+        checkpoint.converged = convergenceMap.converged;
+        return checkpoint;
+    }
+
+    void restore(const Checkpoint &checkpoint) {
+        if (checkpoint.width != width || checkpoint.height != height ||
+            checkpoint.tilesX != convergenceMap.tilesX || checkpoint.tilesY != convergenceMap.tilesY) {
+            fprintf(stderr, "The checkpoint was made with a different resolution or tile size.\n");
+            exit(1);
+        }
+        write(color, checkpoint.accumulation);
+        write(moments, checkpoint.moments);
+        write(albedo, checkpoint.albedo);
+        write(normal, checkpoint.normals);
+        convergenceMap.setConverged(checkpoint.converged);
+        convergence.setTexture(convergenceMap.converged.data(), GL_RED, GL_UNSIGNED_BYTE);
+        convergence.release();
+    }
+
+    void write(Texture2D &texture, const vector<glm::vec4> &data) {
+        texture.setTexture(&data[0].x, GL_RGBA, GL_FLOAT);
+        texture.release();
+    }
+
+    vector<glm::vec4> read(Texture2D &texture) {
+        vector<glm::vec4> data(size_t(width) * height);
+        texture.getTexture(&data[0].x, GL_RGBA, GL_FLOAT);
+        texture.release();
+        return data;
+    }
+
+    // rgb divided by the sample count in a.
+    vector<glm::vec3> average(Texture2D &texture) {
+        vector<glm::vec4> data = read(texture);
+        vector<glm::vec3> pixels(data.size());
+#pragma omp parallel for
+        for (int i = 0; i < (int)data.size(); i++) {
+            pixels[i] = glm::vec3(data[i]) / max(data[i].w, 1.0f);
+        }
+        return pixels;
+    }
+};
+
 class PathTracer {
 private:
     shared_ptr<Window> window;
@@ -24,9 +134,49 @@ private:
     string normal_vert_file = "render.vert";
     string normal_frag_file = "render.frag";
     string texture_vert_file = "texture_render.vert";
-    string texture_frag_file = "texture_render.frag";
+    string texture_frag_file = "accumulation_render.frag";
+
+    Scene scene;
+    TextureBuffer sphereBuffer{GL_RGBA32F, GL_TEXTURE2};
+    TextureBuffer meshNodeBuffer{GL_RGBA32UI, GL_TEXTURE3};
+    TextureBuffer meshTriangleBuffer{GL_RGBA32F, GL_TEXTURE4};
+    // Only built once a pass uses the blue-noise sampler; the mask takes a while to generate.
+    unique_ptr<BlueNoiseMask> blueNoiseMask;
+    unique_ptr<Texture2D> blueNoiseTexture;
 
 public:
+    int numSamples = 1000;
+    // Relative error at which a tile stops receiving samples; 0 disables adaptive sampling.
+    float convergenceThreshold = 0.0f;
+    int convergenceInterval = 32;
+    int tileSize = 16;
+    // GPU time one pass should take; the samples per pass are tuned from timer queries
+    // unless samplesPerPass is set.
+    double passBudgetMs = 30.0;
+    int samplesPerPass = 0;
+    SamplerType samplerType = SOBOL_SAMPLER;
+    // Writes albedo / normal AOVs and runs the a-trous denoiser on the image renderToFile() saves.
+    bool denoise = false;
+    // Saved every checkpointInterval samples and at the end, and resumed from when it exists.
+    // Needs a fixed samplesPerPass, which the checkpoint records, so that a resumed render is
+    // bit-identical to an uninterrupted one.
+    string checkpointPath;
+    int checkpointInterval = 64;
+    // Renders the sample indices [firstSample, numSamples), so several jobs can split one
+    // image; their partials (written to partialPath) are summed by renderer_merge. seed picks
+    // an independent set of sample sequences.
+    int firstSample = 0;
+    uint32_t seed = 0;
+    string partialPath;
+    // When set, every pass is timed on the GPU; a per-pass summary is printed at the end and
+    // the timeline is written there as a Chrome trace.
+    string gpuProfilePath;
+    GpuProfiler profiler;
+    // Time-to-quality benchmark of renderToFile(): when referencePath is set, the error
+    // against it is logged to qualityLogPath (see QualityLog).
+    string referencePath;
+    string qualityLogPath = "quality.csv";
+
     PathTracer(shared_ptr<Window> window)
             : window(window) {
         initialize();
@@ -49,53 +199,318 @@ public:
         fbo.setViewport(window->width, window->height);
         normal_shader.create(normal_vert_file, normal_frag_file);
         texture_shader.create(texture_vert_file, texture_frag_file);
+        setScene(Scene::cornellBox());
+    }
+
+    // Uploads the scene once; the same program renders any scene without recompiling.
+    void setScene(const Scene &newScene) {
+        scene = newScene;
+        vector<glm::vec4> texels = scene.packSpheres();
+        sphereBuffer.setData(texels.data(), sizeof(glm::vec4) * texels.size());
+
+        // The samplers are bound even without a mesh, so they always get a valid buffer.
+        vector<glm::uvec4> nodes(1, glm::uvec4(0u));
+        vector<glm::vec4> triangles(1, glm::vec4(0.0f));
+        if (scene.mesh) {
+            if (scene.mesh->bvh.depth > BVH::MAX_DEPTH) {
+                fprintf(stderr, "BVH depth %d exceeds the traversal stack of render.frag (%d)\n",
+                        scene.mesh->bvh.depth, BVH::MAX_DEPTH);
+                exit(1);
+            }
+            nodes = scene.mesh->packNodes();
+            triangles = scene.mesh->packTriangles();
+        }
+        meshNodeBuffer.setData(nodes.data(), sizeof(glm::uvec4) * nodes.size());
+        meshTriangleBuffer.setData(triangles.data(), sizeof(glm::vec4) * triangles.size());
     }
 
     void render() {
-        int frame = 0;
-        int numSamples = 1000;
         int width, height;
         glfwGetFramebufferSize(window->window, &width, &height);
-        Texture2D colorBuffer(width, height, GL_RGB32F, GL_RGBA);
+        AccumulationTargets targets(width, height, tileSize, convergenceThreshold);
+        clear(targets);
+        SamplesPerPassTuner tuner(passBudgetMs, samplesPerPass);
+        TimerQuery timerQuery;
+        int samples = firstSample;
+        int nextConvergenceCheck = firstSample + convergenceInterval;
+        resume(targets, samples, nextConvergenceCheck);
+        int nextCheckpoint = samples + checkpointInterval;
+        bool converged = false;
+        profiler.enabled = !gpuProfilePath.empty();
         while (*window) {
+            profiler.beginFrame();
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            frame++;
-            cout << frame << endl;
-            if (frame < numSamples) {
-                normal_shader.bind();
-                {
-                    fbo.setViewport(width, height);
-                    fbo.bind();
-                    fbo.attachColorTexture(colorBuffer);
+            if (samples < numSamples && !converged) {
+                profiler.begin("trace");
+                int passSamples = tracePass(targets, samples, numSamples, tuner, timerQuery);
+                profiler.end();
+                samples += passSamples;
+                cout << samples << " samples (" << passSamples << " per pass)" << endl;
+                if (samples >= nextConvergenceCheck) {
+                    GpuProfilerScope scope(profiler, "convergence");
+                    converged = targets.updateConvergence();
+                    nextConvergenceCheck = samples + convergenceInterval;
+                }
+                if (samples >= nextCheckpoint || samples >= numSamples || converged) {
+                    saveCheckpoint(targets, samples, nextConvergenceCheck);
+                    nextCheckpoint = samples + checkpointInterval;
+                }
+            }
 
-                    normal_shader.set_uniform_value(glm::vec2(float(width), float(height)),
-                                                    "resolution");
-                    normal_shader.set_uniform_value(frame, "frame");
-                    normal_shader.set_uniform_value(numSamples, "numSamples");
+            profiler.begin("blit");
+            glViewport(0, 0, width, height);
+            texture_shader.bind();
+            texture_shader.set_uniform_texture(targets.color, "accumulation");
 
-                    glEnable(GL_BLEND);
-                    glBlendFunc(GL_ONE, GL_ONE);
+            vao.draw(GL_TRIANGLES, 6);
 
-                    vao.draw(GL_TRIANGLES, 6);
+            texture_shader.release();
+            targets.color.release();
+            profiler.end();
+        }
+        writeGpuProfile();
+    }
 
-                    glEnable(GL_DEPTH_TEST);
-                    glDisable(GL_BLEND);
+    // Batch rendering: accumulates up to numSamples samples per pixel into an offscreen buffer
+    // as fast as the GPU allows, writes the result once and returns. Nothing is presented.
+    void renderToFile(int width, int height, const string &output) {
+        AccumulationTargets targets(width, height, tileSize, convergenceThreshold);
+        clear(targets);
+        SamplesPerPassTuner tuner(passBudgetMs, samplesPerPass);
+        TimerQuery timerQuery;
 
-                    fbo.release();
+        Timer timer;
+        timer.start();
+        int samples = firstSample;
+        int passes = 0;
+        int nextConvergenceCheck = firstSample + convergenceInterval;
+        resume(targets, samples, nextConvergenceCheck);
+        int nextCheckpoint = samples + checkpointInterval;
+        int checkpointSamples = samples;
+        int nextReport = samples + max((numSamples - samples) / 10, 1);
+        profiler.enabled = !gpuProfilePath.empty();
+        unique_ptr<QualityLog> quality;
+        double measureSeconds = 0.0;
+        if (!referencePath.empty()) {
+            quality = make_unique<QualityLog>(referencePath, qualityLogPath, width, height);
+        }
+        while (samples < numSamples) {
+            // Passes stop at the next log entry, so entries land on the same sample counts as
+            // on the CPU.
+            int sampleEnd = numSamples;
+            if (quality && quality->nextEntry() > samples) {
+                sampleEnd = min(sampleEnd, quality->nextEntry());
+            }
+            profiler.beginFrame();
+            profiler.begin("trace");
+            samples += tracePass(targets, samples, sampleEnd, tuner, timerQuery);
+            profiler.end();
+            passes++;
+            if (quality && quality->due(samples)) {
+                glFinish();
+                const double seconds = timer.stop() - measureSeconds;
+                time_type start = tick();
+                quality->record(seconds, samples, targets.image());
+                measureSeconds += to_duration(start, tick());
+            }
+            if (samples >= nextConvergenceCheck) {
+                GpuProfilerScope scope(profiler, "convergence");
+                if (targets.updateConvergence()) {
+                    break;
                 }
-                normal_shader.release();
+                nextConvergenceCheck = samples + convergenceInterval;
+            }
+            if (samples >= nextCheckpoint) {
+                saveCheckpoint(targets, samples, nextConvergenceCheck);
+                nextCheckpoint = samples + checkpointInterval;
+                checkpointSamples = samples;
+            }
+            if (samples >= nextReport) {
+                glFinish();
+                printf("%d / %d samples, %d per pass (%.1f sec)\n", samples, numSamples,
+                       tuner.samplesPerPass, timer.stop());
+                nextReport = samples + max((numSamples - firstSample) / 10, 1);
             }
+        }
+        // Also after stopping on convergence, so a resume has nothing left to do.
+        if (samples != checkpointSamples) {
+            saveCheckpoint(targets, samples, nextConvergenceCheck);
+        }
+        if (quality && quality->lastSamples != samples) {
+            glFinish();
+            quality->record(timer.stop() - measureSeconds, samples, targets.image());
+        }
+        vector<glm::vec3> pixels = denoise ? Denoiser().denoise(targets.denoiserInput()) : targets.image();
+        printf("Rendering took %.3f sec (%d spp max in %d passes", timer.stop(), samples, passes);
+        if (targets.convergenceMap.enabled()) {
+            printf(", %d / %d tiles converged", targets.convergenceMap.numConverged,
+                   targets.convergenceMap.tilesX * targets.convergenceMap.tilesY);
+        }
+        printf(")\n");
 
-            texture_shader.bind();
+        if (!partialPath.empty()) {
+            PartialAccumulation partial{width, height, firstSample, samples, int(samplerType), seed,
+                                        targets.read(targets.color), targets.read(targets.moments)};
+            partial.save(partialPath);
+        }
+        writeImage(output, pixels, width, height);
+        writeGpuProfile();
+    }
+
+private:
+    void writeGpuProfile() {
+        if (gpuProfilePath.empty()) {
+            return;
+        }
+        profiler.printSummary();
+        if (profiler.writeChromeTrace(gpuProfilePath)) {
+            printf("GPU trace written to %s\n", gpuProfilePath.c_str());
+        }
+    }
+
+    // Continues from checkpointPath if there is a checkpoint.
+    void resume(AccumulationTargets &targets, int &samples, int &nextConvergenceCheck) {
+        if (checkpointPath.empty()) {
+            return;
+        }
+        // Tuned passes depend on timing, and so would the summation order of the result.
+        if (samplesPerPass <= 0) {
+            fprintf(stderr, "Checkpoints need a fixed number of samples per pass (--samples-per-pass).\n");
+            exit(1);
+        }
+        Checkpoint checkpoint;
+        if (!checkpoint.load(checkpointPath)) {
+            return;
+        }
+        if (checkpoint.samplerType != int(samplerType) || checkpoint.seed != seed ||
+            checkpoint.samplesPerPass != samplesPerPass) {
+            fprintf(stderr, "The checkpoint was made with a different sampler, seed or number of samples per pass (%d).\n",
+                    checkpoint.samplesPerPass);
+            exit(1);
+        }
+        targets.restore(checkpoint);
+        samples = checkpoint.samples;
+        nextConvergenceCheck = checkpoint.nextConvergenceCheck;
+        printf("Resuming %s at %d samples\n", checkpointPath.c_str(), samples);
+    }
+
+    void saveCheckpoint(AccumulationTargets &targets, int samples, int nextConvergenceCheck) {
+        if (checkpointPath.empty()) {
+            return;
+        }
+        Checkpoint checkpoint = targets.checkpoint();
+        checkpoint.samples = samples;
+        checkpoint.nextConvergenceCheck = nextConvergenceCheck;
+        checkpoint.samplerType = int(samplerType);
+        checkpoint.samplesPerPass = samplesPerPass;
+        checkpoint.seed = seed;
+        checkpoint.save(checkpointPath);
+    }
+
+private:
+    void clear(AccumulationTargets &targets) {
+        fbo.setViewport(targets.width, targets.height);
+        fbo.attachColorTexture(targets.color, 0);
+        fbo.attachColorTexture(targets.moments, 1);
+        fbo.attachColorTexture(targets.albedo, 2);
+        fbo.attachColorTexture(targets.normal, 3);
+        fbo.setDrawBuffers(4);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        fbo.release();
+    }
+
+    void createBlueNoise() {
+        if (blueNoiseTexture) {
+            return;
+        }
+        blueNoiseMask = make_unique<BlueNoiseMask>();
+        blueNoiseTexture = make_unique<Texture2D>(blueNoiseMask->size, blueNoiseMask->size, GL_R32F, GL_RED,
+                                                  GL_TEXTURE5);
+        blueNoiseTexture->setTexture(blueNoiseMask->values.data(), GL_RED, GL_FLOAT);
+        blueNoiseTexture->release();
+    }
 
-            colorBuffer.bind();
-            glUniform1i(glGetUniformLocation(texture_shader.program_id, "texImage"), 0);
+    // Adds a batch of samples to every pixel, sized by the tuner so the pass fills the time
+    // budget, but ending at sampleEnd at the latest. Returns the number of samples per pixel
+    // that were added.
+    int tracePass(AccumulationTargets &targets, int sampleOffset, int sampleEnd, SamplesPerPassTuner &tuner,
+                  TimerQuery &timerQuery) {
+        double elapsedMs;
+        int measuredSamples;
+        if (timerQuery.poll(elapsedMs, &measuredSamples)) {
+            tuner.update(elapsedMs, measuredSamples);
+        }
+        const int passSamples = min(tuner.samplesPerPass, sampleEnd - sampleOffset);
+        if (samplerType == BLUE_NOISE_SAMPLER) {
+            createBlueNoise();
+        }
+
+        timerQuery.begin();
+        normal_shader.bind();
+        {
+            fbo.setViewport(targets.width, targets.height);
+            fbo.bind();
+            fbo.attachColorTexture(targets.color, 0);
+            fbo.attachColorTexture(targets.moments, 1);
+            fbo.attachColorTexture(targets.albedo, 2);
+            fbo.attachColorTexture(targets.normal, 3);
+            fbo.setDrawBuffers(denoise ? 4 : 2);
+
+            normal_shader.set_uniform_value(glm::vec2(float(targets.width), float(targets.height)),
+                                            "resolution");
+            normal_shader.set_uniform_value(sampleOffset, "frame");
+            normal_shader.set_uniform_value(passSamples, "samplesPerPass");
+            normal_shader.set_uniform_value(tileSize, "tileSize");
+            normal_shader.set_uniform_texture(targets.convergence, "convergenceMap");
+            normal_shader.set_uniform_texture(sphereBuffer, "spheres");
+            normal_shader.set_uniform_value((int)scene.spheres.size(), "numSpheres");
+            normal_shader.set_uniform_texture(meshNodeBuffer, "meshNodes");
+            normal_shader.set_uniform_texture(meshTriangleBuffer, "meshTriangles");
+            normal_shader.set_uniform_value(scene.mesh ? 1 : 0, "hasMesh");
+            if (scene.mesh) {
+                normal_shader.set_uniform_value(scene.mesh->material.color, "meshColor");
+                normal_shader.set_uniform_value(scene.mesh->material.emission, "meshEmission");
+                normal_shader.set_uniform_value((int)scene.mesh->material.reflectType, "meshReflectType");
+            }
+            normal_shader.set_uniform_value(denoise ? 1 : 0, "writeAovs");
+            normal_shader.set_uniform_value((int)samplerType, "samplerType");
+            normal_shader.set_uniform_value((unsigned int)seed, "seed");
+            if (samplerType == BLUE_NOISE_SAMPLER) {
+                normal_shader.set_uniform_texture(*blueNoiseTexture, "blueNoise");
+                normal_shader.set_uniform_value(blueNoiseMask->size, "blueNoiseSize");
+            } else {
+                // Keeps the unused sampler off the units the other samplers are bound to.
+                normal_shader.set_uniform_value(int(GL_TEXTURE5 - GL_TEXTURE0), "blueNoise");
+                normal_shader.set_uniform_value(1, "blueNoiseSize");
+            }
+            normal_shader.set_uniform_value(scene.camera.position, "cameraPosition");
+            normal_shader.set_uniform_value(scene.camera.dir, "cameraDir");
+            normal_shader.set_uniform_value(scene.camera.up, "cameraUp");
+            normal_shader.set_uniform_value(scene.camera.screenDist, "screenDist");
+            normal_shader.set_uniform_value(scene.camera.screenHeight, "screenHeight");
+
+            glDisable(GL_DEPTH_TEST);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
 
             vao.draw(GL_TRIANGLES, 6);
 
-            texture_shader.release();
-            colorBuffer.release();
+            glEnable(GL_DEPTH_TEST);
+            glDisable(GL_BLEND);
+
+            sphereBuffer.release();
+            meshNodeBuffer.release();
+            meshTriangleBuffer.release();
+            if (blueNoiseTexture) {
+                blueNoiseTexture->release();
+            }
+            targets.convergence.release();
+            fbo.release();
         }
+        normal_shader.release();
+        timerQuery.end(passSamples);
+        return passSamples;
     }
 };
 
@@ -0,0 +1,304 @@
+#include "core/common.h"
+#include "core/Timer.h"
+#include "mesh/TriMeshLoader.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef _WIN32
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// Throughput of the mesh pipeline stages on the tinyply sample assets:
+//
+//   renderer_bench [--repeat N] [--warmup N] [--json FILE] [MESH...]
+//
+// Every stage runs warmup + repeat times per mesh on a fresh copy of the loaded mesh; the
+// statistics cover the timed repetitions only. Throughput is computed from the median.
+// "load" parses the file and computes the derived data, "loadCache" reads the same mesh from
+// a .tmesh cache. Stages marked "(scalar)" force the scalar GeometryKernels for comparison;
+// the SoA positions they work on are built inside every stage, as on first use.
+// Without MESH arguments the bundled assets are measured.
+
+#ifndef RENDERER_ASSETS_DIR
+#define RENDERER_ASSETS_DIR "ext/tinyply/assets"
+#endif
+
+struct BenchOptions {
+    int repeat = 10;
+    int warmup = 2;
+    string json = "bench.json";
+    vector<string> meshes;
+};
+
+struct StageResult {
+    string name;
+    vector<double> ms;
+    // Bytes read or written by one run, 0 for in-memory stages.
+    uintmax_t bytes = 0;
+    double peakRssMB = 0.0;
+
+    double median() const {
+        vector<double> sorted = ms;
+        sort(sorted.begin(), sorted.end());
+        const size_t n = sorted.size();
+        return n % 2 ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+    }
+
+    double mean() const {
+        double sum = 0.0;
+        for (double t : ms) {
+            sum += t;
+        }
+        return sum / ms.size();
+    }
+
+    double stddev() const {
+        const double m = mean();
+        double sum = 0.0;
+        for (double t : ms) {
+            sum += (t - m) * (t - m);
+        }
+        return ms.size() > 1 ? sqrt(sum / (ms.size() - 1)) : 0.0;
+    }
+};
+
+struct MeshResult {
+    string name;
+    uintmax_t bytes = 0;
+    unsigned int verN = 0;
+    unsigned int faceN = 0;
+    vector<StageResult> stages;
+    // Vertex cache efficiency of the file order and after optimizeRenderOrder().
+    MeshOptimizer::Stats renderOrder;
+};
+
+// Peak resident set size of the process so far, in MB.
+static double peakRssMB() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return double(counters.PeakWorkingSetSize) / (1024.0 * 1024.0);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return double(usage.ru_maxrss) / (1024.0 * 1024.0);
+#else
+    return double(usage.ru_maxrss) / 1024.0;
+#endif
+#endif
+}
+
+// Times stage(mesh) on a copy of source made outside the timed region.
+template<typename Stage>
+static StageResult measure(const string &name, const TriMesh &source, const BenchOptions &options, Stage stage) {
+    StageResult result;
+    result.name = name;
+    for (int i = 0; i < options.warmup + options.repeat; i++) {
+        TriMesh mesh = source;
+        time_type start = tick();
+        stage(mesh);
+        const double ms = to_duration(start, tick()) * 1000.0;
+        if (i >= options.warmup) {
+            result.ms.push_back(ms);
+        }
+    }
+    result.peakRssMB = peakRssMB();
+    return result;
+}
+
+static MeshResult benchMesh(const string &path, const BenchOptions &options) {
+    MeshResult result;
+    result.name = filesystem::path(path).filename().string();
+    result.bytes = filesystem::file_size(path);
+
+    TriMesh loaded;
+    TriMeshLoader loader;
+    loader.verbose = false;
+    loader.useCache = false;
+    StageResult load = measure("load", loaded, options, [&](TriMesh &mesh) {
+        mesh = loader.load(path);
+    });
+    load.bytes = result.bytes;
+    result.stages.push_back(load);
+    loaded = loader.load(path);
+    result.verN = loaded.verN;
+    result.faceN = loaded.faceN;
+
+    const string outStem = (filesystem::temp_directory_path() / ("renderer_bench_" + filesystem::path(path).stem().string())).string();
+    const string cachePath = outStem + MESH_CACHE_EXTENSION;
+    MeshCache::save(cachePath, loaded, nullptr, "");
+    StageResult cache = measure("loadCache", loaded, options, [&](TriMesh &mesh) {
+        MeshCache::load(cachePath, mesh, nullptr);
+    });
+    cache.bytes = filesystem::file_size(cachePath);
+    filesystem::remove(cachePath);
+    result.stages.push_back(cache);
+
+    result.stages.push_back(measure("computeFaceNormals", loaded, options, [](TriMesh &mesh) {
+        mesh.computeFaceNormals();
+    }));
+    result.stages.push_back(measure("computeFaceNormals(scalar)", loaded, options, [](TriMesh &mesh) {
+        const GeometryKernels::Level level = GeometryKernels::level();
+        GeometryKernels::setLevel(GeometryKernels::SCALAR);
+        mesh.computeFaceNormals();
+        GeometryKernels::setLevel(level);
+    }));
+    result.stages.push_back(measure("computeFaceCenters", loaded, options, [](TriMesh &mesh) {
+        mesh.computeFaceCenters();
+    }));
+    result.stages.push_back(measure("computeVerNormals", loaded, options, [](TriMesh &mesh) {
+        mesh.computeVerNormals();
+    }));
+    result.stages.push_back(measure("computeVerNormals(angle)", loaded, options, [](TriMesh &mesh) {
+        mesh.computeVerNormals(ANGLE_WEIGHTED);
+    }));
+    result.stages.push_back(measure("weldVertices", loaded, options, [](TriMesh &mesh) {
+        mesh.weldVertices();
+    }));
+    result.stages.push_back(measure("weldVertices(1e-4)", loaded, options, [](TriMesh &mesh) {
+        mesh.weldVertices(1e-4f);
+    }));
+    result.stages.push_back(measure("computeAABB", loaded, options, [](TriMesh &mesh) {
+        mesh.computeAABB();
+    }));
+    result.stages.push_back(measure("computeAABB(scalar)", loaded, options, [](TriMesh &mesh) {
+        const GeometryKernels::Level level = GeometryKernels::level();
+        GeometryKernels::setLevel(GeometryKernels::SCALAR);
+        mesh.computeAABB();
+        GeometryKernels::setLevel(level);
+    }));
+
+    result.stages.push_back(measure("optimizeRenderOrder", loaded, options, [](TriMesh &mesh) {
+        mesh.optimizeRenderOrder();
+    }));
+    result.stages.push_back(measure("optimizeRenderOrder(overdraw)", loaded, options, [](TriMesh &mesh) {
+        MeshOptimizer::Options optimize;
+        optimize.overdraw = true;
+        mesh.optimizeRenderOrder(optimize);
+    }));
+    {
+        TriMesh mesh = loaded;
+        result.renderOrder = mesh.optimizeRenderOrder();
+    }
+
+    StageResult write = measure("writePly", loaded, options, [&](TriMesh &mesh) {
+        mesh.writePly(outStem);
+    });
+    write.bytes = filesystem::file_size(outStem + ".ply");
+    filesystem::remove(outStem + ".ply");
+    result.stages.push_back(write);
+    return result;
+}
+
+static void printResult(const MeshResult &mesh) {
+    printf("%s: %u vertices, %u faces, %.2f MB\n", mesh.name.c_str(), mesh.verN, mesh.faceN, mesh.bytes / 1e6);
+    printf("  render order: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", mesh.renderOrder.before.acmr,
+           mesh.renderOrder.after.acmr, mesh.renderOrder.before.atvr, mesh.renderOrder.after.atvr);
+    printf("  %-30s %10s %10s %10s %12s %10s %10s\n", "stage", "median ms", "min ms", "stddev", "Mfaces/s", "MB/s", "peak MB");
+    for (const StageResult &stage : mesh.stages) {
+        const double seconds = stage.median() / 1000.0;
+        const double minMs = *min_element(stage.ms.begin(), stage.ms.end());
+        printf("  %-30s %10.3f %10.3f %10.3f %12.2f ", stage.name.c_str(), stage.median(), minMs, stage.stddev(),
+               mesh.faceN / seconds / 1e6);
+        if (stage.bytes > 0) {
+            printf("%10.1f", stage.bytes / seconds / 1e6);
+        } else {
+            printf("%10s", "-");
+        }
+        printf(" %10.1f\n", stage.peakRssMB);
+    }
+}
+
+static void writeJson(const string &path, const vector<MeshResult> &results, const BenchOptions &options) {
+    ofstream file(path);
+    if (file.fail()) {
+        fprintf(stderr, "Can't write \"%s\".\n", path.c_str());
+        exit(1);
+    }
+    char line[512];
+    file << "{\n  \"version\": 1,\n";
+#ifdef NDEBUG
+    file << "  \"build\": \"release\",\n";
+#else
+    file << "  \"build\": \"debug\",\n";
+#endif
+#ifdef _OPENMP
+    file << "  \"threads\": " << omp_get_max_threads() << ",\n";
+#else
+    file << "  \"threads\": 1,\n";
+#endif
+    file << "  \"geometryKernels\": \"" << GeometryKernels::levelName(GeometryKernels::level()) << "\",\n";
+    file << "  \"repeat\": " << options.repeat << ",\n  \"warmup\": " << options.warmup << ",\n";
+    file << "  \"peakRssMB\": " << peakRssMB() << ",\n  \"meshes\": [";
+    for (size_t m = 0; m < results.size(); m++) {
+        const MeshResult &mesh = results[m];
+        snprintf(line, sizeof(line), "%s\n    {\"name\": \"%s\", \"bytes\": %llu, \"vertices\": %u, \"faces\": %u, "
+                 "\"acmrBefore\": %.4f, \"acmrAfter\": %.4f, \"atvrBefore\": %.4f, \"atvrAfter\": %.4f, \"stages\": [",
+                 m == 0 ? "" : ",", mesh.name.c_str(), (unsigned long long)mesh.bytes, mesh.verN, mesh.faceN,
+                 mesh.renderOrder.before.acmr, mesh.renderOrder.after.acmr, mesh.renderOrder.before.atvr,
+                 mesh.renderOrder.after.atvr);
+        file << line;
+        for (size_t s = 0; s < mesh.stages.size(); s++) {
+            const StageResult &stage = mesh.stages[s];
+            const double seconds = stage.median() / 1000.0;
+            snprintf(line, sizeof(line),
+                     "%s\n      {\"name\": \"%s\", \"medianMs\": %.4f, \"meanMs\": %.4f, \"minMs\": %.4f, \"maxMs\": %.4f, "
+                     "\"stddevMs\": %.4f, \"samples\": %d, \"facesPerSec\": %.1f, \"mbPerSec\": %.3f, \"peakRssMB\": %.2f}",
+                     s == 0 ? "" : ",", stage.name.c_str(), stage.median(), stage.mean(),
+                     *min_element(stage.ms.begin(), stage.ms.end()), *max_element(stage.ms.begin(), stage.ms.end()),
+                     stage.stddev(), int(stage.ms.size()), mesh.faceN / seconds,
+                     stage.bytes > 0 ? stage.bytes / seconds / 1e6 : 0.0, stage.peakRssMB);
+            file << line;
+        }
+        file << "\n    ]}";
+    }
+    file << "\n  ]\n}\n";
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--repeat" && hasValue) {
+            options.repeat = max(atoi(argv[++i]), 1);
+        } else if (arg == "--warmup" && hasValue) {
+            options.warmup = max(atoi(argv[++i]), 0);
+        } else if (arg == "--json" && hasValue) {
+            options.json = argv[++i];
+        } else if (arg.rfind("--", 0) == 0) {
+            fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            fprintf(stderr, "usage: %s [--repeat N] [--warmup N] [--json FILE] [MESH...]\n", argv[0]);
+            exit(1);
+        } else {
+            options.meshes.push_back(arg);
+        }
+    }
+    if (options.meshes.empty()) {
+        for (const char *name : {"bunny.ply", "sofa.ply", "sofa_ascii.ply", "elephant.ply"}) {
+            options.meshes.push_back((filesystem::path(RENDERER_ASSETS_DIR) / name).string());
+        }
+    }
+
+    vector<MeshResult> results;
+    for (const string &path : options.meshes) {
+        if (!filesystem::exists(path)) {
+            fprintf(stderr, "\"%s\" does not exist.\n", path.c_str());
+            exit(1);
+        }
+        results.push_back(benchMesh(path, options));
+    }
+    printf("Geometry kernels: %s\n", GeometryKernels::levelName(GeometryKernels::level()));
+    for (const MeshResult &mesh : results) {
+        printResult(mesh);
+    }
+    writeJson(options.json, results, options);
+    printf("Results written to %s\n", options.json.c_str());
+    return 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "core/common.h"
+#include "stb/stb_image.h"
+#include "stb/stb_image_write.h"
+
+// Writes linear RGB pixels stored bottom row first (gl_FragCoord / glReadPixels order).
+// ".hdr" keeps the float values, every other format is clamped and gamma corrected.
+inline bool writeImage(const string &path, const vector<glm::vec3> &pixels, int width, int height, float gamma = 2.2f) {
+    string extension = filesystem::path(path).extension().string();
+    stbi_flip_vertically_on_write(1);
+    int hasSaved = 0;
+    if (extension == ".hdr") {
+        hasSaved = stbi_write_hdr(path.c_str(), width, height, 3, glm::value_ptr(pixels[0]));
+    } else {
+        vector<unsigned char> ldr(size_t(width) * height * 3);
+#pragma omp parallel for
+        for (int i = 0; i < width * height; i++) {
+            for (int j = 0; j < 3; j++) {
+                float c = pow(glm::clamp(pixels[i][j], 0.0f, 1.0f), 1.0f / gamma);
+                ldr[3 * i + j] = (unsigned char)(c * 255.0f + 0.5f);
+            }
+        }
+        if (extension == ".bmp") {
+            hasSaved = stbi_write_bmp(path.c_str(), width, height, 3, ldr.data());
+        } else if (extension == ".tga") {
+            hasSaved = stbi_write_tga(path.c_str(), width, height, 3, ldr.data());
+        } else if (extension == ".jpg" || extension == ".jpeg") {
+            hasSaved = stbi_write_jpg(path.c_str(), width, height, 3, ldr.data(), 95);
+        } else {
+            hasSaved = stbi_write_png(path.c_str(), width, height, 3, ldr.data(), 0);
+        }
+    }
+    stbi_flip_vertically_on_write(0);
+    if (!hasSaved) {
+        fprintf(stderr, "Failed to write \"%s\".\n", path.c_str());
+    }
+    return hasSaved != 0;
+}
+
+// Reads an image written by writeImage() back into linear RGB, bottom row first. LDR formats
+// are linearized with stb_image's default gamma of 2.2.
+inline bool readImage(const string &path, vector<glm::vec3> &pixels, int &width, int &height) {
+    stbi_set_flip_vertically_on_load(1);
+    int channels = 0;
+    float *data = stbi_loadf(path.c_str(), &width, &height, &channels, 3);
+    stbi_set_flip_vertically_on_load(0);
+    if (!data) {
+        fprintf(stderr, "Failed to read \"%s\": %s\n", path.c_str(), stbi_failure_reason());
+        return false;
+    }
+    pixels.resize(size_t(width) * height);
+    for (size_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = glm::vec3(data[3 * i + 0], data[3 * i + 1], data[3 * i + 2]);
+    }
+    stbi_image_free(data);
+    return true;
+}
+
+#endif //IMAGE_H
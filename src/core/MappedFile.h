@@ -0,0 +1,99 @@
+#pragma once
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include "core/common.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. The pages are loaded on first access, so
+// parsers can hand disjoint ranges to threads without reading the file up front.
+class MappedFile {
+private:
+    const char *mapped = nullptr;
+    size_t fileSize = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+    // Exits if path can't be opened or mapped.
+    explicit MappedFile(const string &path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER size;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)) {
+            fprintf(stderr, "Can't open \"%s\".\n", path.c_str());
+            exit(1);
+        }
+        fileSize = size_t(size.QuadPart);
+        if (fileSize > 0) {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            mapped = mapping ? static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+            if (!mapped) {
+                fprintf(stderr, "Can't map \"%s\".\n", path.c_str());
+                exit(1);
+            }
+        }
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat status;
+        if (fd < 0 || fstat(fd, &status) != 0) {
+            fprintf(stderr, "Can't open \"%s\".\n", path.c_str());
+            exit(1);
+        }
+        fileSize = size_t(status.st_size);
+        if (fileSize > 0) {
+            void *address = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                fprintf(stderr, "Can't map \"%s\".\n", path.c_str());
+                exit(1);
+            }
+            // The file is read front to back, in parallel chunks.
+            madvise(address, fileSize, MADV_WILLNEED);
+            mapped = static_cast<const char *>(address);
+        }
+        ::close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (mapped) {
+            UnmapViewOfFile(mapped);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+#else
+        if (mapped) {
+            munmap(const_cast<char *>(mapped), fileSize);
+        }
+#endif
+    }
+
+    // nullptr for an empty file.
+    const char *data() const {
+        return mapped;
+    }
+
+    size_t size() const {
+        return fileSize;
+    }
+};
+
+#endif //MAPPED_FILE_H
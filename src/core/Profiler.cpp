@@ -0,0 +1,183 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+    // Buffers live until exit, so zones of finished threads can still be exported.
+    std::mutex registryMutex;
+    std::vector<std::unique_ptr<Profiler::ThreadBuffer>> registry;
+
+    const uint64_t startTicks = Profiler::now();
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    struct ThreadZone {
+        Profiler::Zone zone;
+        int threadIndex;
+    };
+
+    // Copies the zones of every thread, each thread's zones ordered parent first.
+    std::vector<ThreadZone> snapshot() {
+        std::vector<ThreadZone> zones;
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (const std::unique_ptr<Profiler::ThreadBuffer> &buffer : registry) {
+            const uint64_t head = buffer->head.load(std::memory_order_acquire);
+            const uint64_t count = std::min<uint64_t>(head, Profiler::ThreadBuffer::CAPACITY);
+            const size_t first = zones.size();
+            for (uint64_t i = head - count; i < head; i++) {
+                zones.push_back(ThreadZone{buffer->zones[i & (Profiler::ThreadBuffer::CAPACITY - 1)], buffer->threadIndex});
+            }
+            std::sort(zones.begin() + first, zones.end(), [](const ThreadZone &a, const ThreadZone &b) {
+                if (a.zone.begin != b.zone.begin) {
+                    return a.zone.begin < b.zone.begin;
+                }
+                return a.zone.depth < b.zone.depth;
+            });
+        }
+        return zones;
+    }
+}
+
+double Profiler::nanosecondsPerTick() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    // Measures the TSC rate over at least 10 ms since startup.
+    uint64_t ticks;
+    std::chrono::steady_clock::time_point time;
+    do {
+        ticks = now();
+        time = std::chrono::steady_clock::now();
+    } while (time - startTime < std::chrono::milliseconds(10));
+    const double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(time - startTime).count());
+    return ns / double(ticks - startTicks);
+#else
+    return 1.0;
+#endif
+}
+
+Profiler::ThreadBuffer &Profiler::threadBuffer() {
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (!buffer) {
+        std::unique_ptr<ThreadBuffer> created = std::make_unique<ThreadBuffer>();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        created->threadIndex = int(registry.size());
+        buffer = created.get();
+        registry.push_back(std::move(created));
+    }
+    return *buffer;
+}
+
+void Profiler::clear() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const std::unique_ptr<ThreadBuffer> &buffer : registry) {
+        buffer->head.store(0, std::memory_order_release);
+    }
+}
+
+bool Profiler::writeFolded(const std::string &path) {
+    const std::vector<ThreadZone> zones = snapshot();
+    const double nsPerTick = nanosecondsPerTick();
+
+    // Walks each thread's zones in start order, keeping the chain of open ancestors.
+    std::map<std::string, double> selfMicroseconds;
+    std::vector<size_t> stack;
+    std::vector<std::string> stackNames;
+    std::vector<uint64_t> childTicks(zones.size(), 0);
+    auto close = [&]() {
+        const Zone &zone = zones[stack.back()].zone;
+        const uint64_t ticks = zone.end - zone.begin;
+        const uint64_t self = ticks > childTicks[stack.back()] ? ticks - childTicks[stack.back()] : 0;
+        selfMicroseconds[stackNames.back()] += double(self) * nsPerTick / 1e3;
+        stack.pop_back();
+        stackNames.pop_back();
+    };
+    for (size_t i = 0; i < zones.size(); i++) {
+        if (i > 0 && zones[i].threadIndex != zones[i - 1].threadIndex) {
+            while (!stack.empty()) {
+                close();
+            }
+        }
+        while (!stack.empty() && zones[stack.back()].zone.depth >= zones[i].zone.depth) {
+            close();
+        }
+        if (!stack.empty()) {
+            childTicks[stack.back()] += zones[i].zone.end - zones[i].zone.begin;
+        }
+        stackNames.push_back(stack.empty() ? std::string(zones[i].zone.name)
+                                           : stackNames.back() + ";" + zones[i].zone.name);
+        stack.push_back(i);
+    }
+    while (!stack.empty()) {
+        close();
+    }
+
+    std::ofstream file(path);
+    if (file.fail()) {
+        fprintf(stderr, "Can't write \"%s\".\n", path.c_str());
+        return false;
+    }
+    for (const auto &entry : selfMicroseconds) {
+        file << entry.first << " " << uint64_t(entry.second + 0.5) << "\n";
+    }
+    return !file.fail();
+}
+
+bool Profiler::writeChromeTrace(const std::string &path) {
+    const std::vector<ThreadZone> zones = snapshot();
+    const double nsPerTick = nanosecondsPerTick();
+    uint64_t origin = UINT64_MAX;
+    for (const ThreadZone &zone : zones) {
+        origin = std::min(origin, zone.zone.begin);
+    }
+
+    std::ofstream file(path);
+    if (file.fail()) {
+        fprintf(stderr, "Can't write \"%s\".\n", path.c_str());
+        return false;
+    }
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    char line[256];
+    for (size_t i = 0; i < zones.size(); i++) {
+        const Zone &zone = zones[i].zone;
+        snprintf(line, sizeof(line),
+                 "%s\n{\"name\":\"%s\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                 i == 0 ? "" : ",", zone.name, zones[i].threadIndex,
+                 double(zone.begin - origin) * nsPerTick / 1e3, double(zone.end - zone.begin) * nsPerTick / 1e3);
+        file << line;
+    }
+    file << "\n]}\n";
+    return !file.fail();
+}
+
+void Profiler::printSummary(FILE *out) {
+    const std::vector<ThreadZone> zones = snapshot();
+    const double nsPerTick = nanosecondsPerTick();
+    struct Total {
+        std::string name;
+        int count = 0;
+        double ms = 0.0;
+    };
+    std::map<std::string, Total> totals;
+    for (const ThreadZone &zone : zones) {
+        Total &total = totals[zone.zone.name];
+        total.name = zone.zone.name;
+        total.count++;
+        total.ms += double(zone.zone.end - zone.zone.begin) * nsPerTick / 1e6;
+    }
+    std::vector<Total> sorted;
+    for (const auto &entry : totals) {
+        sorted.push_back(entry.second);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Total &a, const Total &b) {
+        return a.ms > b.ms;
+    });
+    fprintf(out, "%-32s %10s %12s %12s\n", "zone", "count", "total ms", "mean us");
+    for (const Total &total : sorted) {
+        fprintf(out, "%-32s %10d %12.3f %12.3f\n", total.name.c_str(), total.count, total.ms,
+                total.ms * 1e3 / total.count);
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Hierarchical CPU profiler. PROFILE_SCOPE("name") records the enclosing block as a zone
+// on the calling thread; zones nest by lexical scope and may be opened inside OpenMP
+// regions. Each thread appends to its own ring buffer (no locks, no allocation on the hot
+// path; the oldest zones are overwritten when it is full), and the buffers are merged only
+// when exporting:
+//
+//   Profiler::writeFolded("profile.folded");  // flamegraph.pl / speedscope, self time in us
+//   Profiler::writeChromeTrace("profile.json");
+//   Profiler::printSummary();
+//
+// Zones are recorded only when the build defines RENDERER_PROFILE (cmake -DRENDERER_PROFILE=ON);
+// otherwise the macros expand to nothing and the release build pays nothing. Zone names
+// must be string literals (or otherwise outlive the profiler), as only the pointer is kept.
+// Export while no zone is being recorded, e.g. outside parallel regions.
+namespace Profiler {
+    // Timestamps in ticks: rdtsc on x86, steady_clock nanoseconds elsewhere.
+    inline uint64_t now();
+
+    // Nanoseconds per tick, calibrated against steady_clock.
+    double nanosecondsPerTick();
+
+    struct Zone {
+        const char *name;
+        uint64_t begin;
+        uint64_t end;
+        uint32_t depth;
+    };
+
+    // Single-producer ring of one thread. Only the owning thread writes; head is published
+    // with release order so an exporter sees complete zones.
+    struct ThreadBuffer {
+        static constexpr size_t CAPACITY = size_t(1) << 16;
+        Zone zones[CAPACITY];
+        std::atomic<uint64_t> head{0};
+        uint32_t depth = 0;
+        int threadIndex = 0;
+
+        void push(const char *name, uint64_t begin, uint64_t end, uint32_t zoneDepth) {
+            const uint64_t h = head.load(std::memory_order_relaxed);
+            zones[h & (CAPACITY - 1)] = Zone{name, begin, end, zoneDepth};
+            head.store(h + 1, std::memory_order_release);
+        }
+    };
+
+    // Buffer of the calling thread, registered on first use.
+    ThreadBuffer &threadBuffer();
+
+    // Drops every recorded zone.
+    void clear();
+
+    // One line per stack, "outer;inner;leaf <self time in microseconds>", summed over all
+    // threads. Returns false if path can't be written.
+    bool writeFolded(const std::string &path);
+
+    // Chrome trace event format (chrome://tracing or https://ui.perfetto.dev), one track per
+    // thread.
+    bool writeChromeTrace(const std::string &path);
+
+    // Inclusive time and call count per zone name.
+    void printSummary(FILE *out = stdout);
+
+    class ScopedZone {
+    private:
+        const char *name;
+        uint64_t begin;
+        ThreadBuffer &buffer;
+
+    public:
+        explicit ScopedZone(const char *name)
+                : name(name), buffer(threadBuffer()) {
+            buffer.depth++;
+            begin = now();
+        }
+
+        ~ScopedZone() {
+            const uint64_t end = now();
+            buffer.depth--;
+            buffer.push(name, begin, end, buffer.depth);
+        }
+
+        ScopedZone(const ScopedZone &) = delete;
+        ScopedZone &operator=(const ScopedZone &) = delete;
+    };
+}
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+inline uint64_t Profiler::now() {
+    return __rdtsc();
+}
+#else
+#include <chrono>
+inline uint64_t Profiler::now() {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+#endif
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef RENDERER_PROFILE
+#define PROFILE_SCOPE(name) ::Profiler::ScopedZone PROFILE_CONCAT(profileZone_, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__func__)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_FUNCTION() ((void)0)
+#endif
+
+#endif //PROFILER_H
@@ -6,12 +6,14 @@
 #define TIMER_H
 
 #include <chrono>
-typedef std::chrono::time_point<std::chrono::system_clock> time_type;
+// Wall time in seconds at the resolution of steady_clock (which, unlike system_clock, never
+// jumps). Use PROFILE_SCOPE from core/Profiler.h for per-stage timings.
+typedef std::chrono::time_point<std::chrono::steady_clock> time_type;
 inline time_type tick() {
-    return std::chrono::system_clock::now();
+    return std::chrono::steady_clock::now();
 }
 inline double to_duration(time_type start, time_type end) {
-    return std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() / 1000.0;
+    return std::chrono::duration<double>(end - start).count();
 }
 
 class Timer {
@@ -24,6 +24,9 @@
 #include <memory>
 #include <fstream>
 #include<math.h>
+#include<cfloat>
+#include<climits>
+#include<cstring>
 #include<algorithm>
 #include<cassert>
 #include<sstream>
@@ -1,12 +1,248 @@
 ﻿#include "core/Timer.h"
 #include "core/common.h"
+#include "core/Profiler.h"
+#include "core/Image.h"
 #include "PathTracer.h"
+#include "pathtracer/CpuPathTracer.h"
+#include "pathtracer/QualityLog.h"
+#include "pathtracer/SceneLoader.h"
+#include "mesh/TriMeshLoader.h"
 
+struct Options {
+    bool cpu = false;
+    bool headless = false;
+    int width = 640;
+    int height = 480;
+    int numSamples = 1000;
+    float threshold = 0.0f;
+    double passBudgetMs = 0.0;
+    int samplesPerPass = 0;
+    SamplerType sampler = SOBOL_SAMPLER;
+    bool denoise = false;
+    string checkpoint;
+    int checkpointInterval = 64;
+    int firstSample = 0;
+    uint32_t seed = 0;
+    string partial;
+    string gpuProfile;
+    string cpuProfile;
+    string reference;
+    string qualityLog = "quality.csv";
+    string output = "render.png";
+    string scene;
+    string mesh;
+};
+
+Options parseOptions(int argc, char **argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--cpu") {
+            options.cpu = true;
+        } else if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--denoise") {
+            options.denoise = true;
+        } else if (arg == "--width" && hasValue) {
+            options.width = atoi(argv[++i]);
+        } else if (arg == "--height" && hasValue) {
+            options.height = atoi(argv[++i]);
+        } else if (arg == "--samples" && hasValue) {
+            options.numSamples = atoi(argv[++i]);
+        } else if (arg == "--threshold" && hasValue) {
+            options.threshold = float(atof(argv[++i]));
+        } else if (arg == "--pass-budget" && hasValue) {
+            options.passBudgetMs = atof(argv[++i]);
+        } else if (arg == "--samples-per-pass" && hasValue) {
+            options.samplesPerPass = atoi(argv[++i]);
+        } else if (arg == "--sampler" && hasValue) {
+            string name = argv[++i];
+            if (name == "random") {
+                options.sampler = RANDOM_SAMPLER;
+            } else if (name == "sobol") {
+                options.sampler = SOBOL_SAMPLER;
+            } else if (name == "bluenoise") {
+                options.sampler = BLUE_NOISE_SAMPLER;
+            } else {
+                fprintf(stderr, "Unknown sampler: %s (random, sobol or bluenoise)\n", name.c_str());
+                exit(1);
+            }
+        } else if (arg == "--checkpoint" && hasValue) {
+            options.checkpoint = argv[++i];
+        } else if (arg == "--checkpoint-interval" && hasValue) {
+            options.checkpointInterval = max(atoi(argv[++i]), 1);
+        } else if (arg == "--sample-range" && hasValue) {
+            if (sscanf(argv[++i], "%d:%d", &options.firstSample, &options.numSamples) != 2 ||
+                options.firstSample < 0 || options.firstSample >= options.numSamples) {
+                fprintf(stderr, "Invalid sample range: %s (expected BEGIN:END)\n", argv[i]);
+                exit(1);
+            }
+        } else if (arg == "--seed" && hasValue) {
+            options.seed = uint32_t(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--partial" && hasValue) {
+            options.partial = argv[++i];
+        } else if (arg == "--gpu-profile" && hasValue) {
+            options.gpuProfile = argv[++i];
+        } else if (arg == "--cpu-profile" && hasValue) {
+            options.cpuProfile = argv[++i];
+        } else if (arg == "--reference" && hasValue) {
+            options.reference = argv[++i];
+        } else if (arg == "--quality-log" && hasValue) {
+            options.qualityLog = argv[++i];
+        } else if (arg == "--scene" && hasValue) {
+            options.scene = argv[++i];
+        } else if (arg == "--mesh" && hasValue) {
+            options.mesh = argv[++i];
+        } else if (arg == "--output" && hasValue) {
+            options.output = argv[++i];
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            fprintf(stderr, "usage: %s [--cpu | --headless] [--scene FILE] [--mesh FILE] [--width W] [--height H] [--samples N] [--threshold REL_ERROR]\n"
+                            "       [--pass-budget MS | --samples-per-pass N] [--sampler random|sobol|bluenoise] [--denoise]\n"
+                            "       [--checkpoint FILE [--checkpoint-interval N]] [--sample-range BEGIN:END] [--seed N]\n"
+                            "       [--partial FILE] [--gpu-profile TRACE.json] [--cpu-profile PREFIX]\n"
+                            "       [--reference REF.hdr [--quality-log FILE.csv]] [--output FILE]\n", argv[0]);
+            exit(1);
+        }
+    }
+    return options;
+}
+
+Scene loadScene(const Options &options) {
+    Scene scene = Scene::cornellBox();
+    if (!options.scene.empty()) {
+        SceneLoader loader;
+        scene = loader.load(options.scene);
+    }
+    if (!options.mesh.empty()) {
+        // Stands on the floor of the Cornell box, between the two mirror spheres.
+        TriMeshLoader loader;
+        loader.derived = 0;
+        BVH bvh;
+        TriMesh mesh = loader.load(options.mesh, &bvh);
+        scene.mesh = make_shared<MeshObject>(mesh, glm::vec3(50.0f, 0.0f, 100.0f), 35.0f,
+                                             Material{glm::vec3(0.75f), glm::vec3(0.0f), DIFFUSE}, &bvh);
+    }
+    return scene;
+}
+
+void renderCpu(const Options &options) {
+    CpuPathTracer pt(loadScene(options), options.width, options.height, options.threshold);
+    pt.samplerType = options.sampler;
+    pt.seed = options.seed;
+    pt.numSamplesAccumulated = options.firstSample;
+    // The chunk size only depends on the options, so a resumed render splits its samples
+    // exactly like an uninterrupted one; the checkpoint records it to make sure.
+    int interval = pt.convergence.enabled() ? 32 : options.numSamples;
+    if (!options.checkpoint.empty()) {
+        interval = options.checkpointInterval;
+    }
+    Checkpoint checkpoint;
+    if (!options.checkpoint.empty() && checkpoint.load(options.checkpoint)) {
+        if (checkpoint.samplesPerPass != interval) {
+            fprintf(stderr, "The checkpoint was made with --checkpoint-interval %d.\n", checkpoint.samplesPerPass);
+            exit(1);
+        }
+        pt.restore(checkpoint);
+        printf("Resuming %s at %d samples\n", options.checkpoint.c_str(), pt.numSamplesAccumulated);
+    }
+    unique_ptr<QualityLog> quality;
+    if (!options.reference.empty()) {
+        quality = make_unique<QualityLog>(options.reference, options.qualityLog, pt.width, pt.height);
+    }
+    RenderStats stats;
+    while (pt.numSamplesAccumulated < options.numSamples) {
+        int chunk = min(interval, options.numSamples - pt.numSamplesAccumulated);
+        if (quality && quality->nextEntry() > pt.numSamplesAccumulated) {
+            chunk = min(chunk, quality->nextEntry() - pt.numSamplesAccumulated);
+        }
+        RenderStats pass = pt.render(chunk);
+        stats.seconds += pass.seconds;
+        stats.rays += pass.rays;
+        stats.samples += pass.samples;
+        if (quality && quality->due(pt.numSamplesAccumulated)) {
+            quality->record(stats.seconds, pt.numSamplesAccumulated, pt.image());
+        }
+        bool converged = pt.updateConvergence();
+        if (!options.checkpoint.empty()) {
+            Checkpoint checkpoint = pt.checkpoint();
+            checkpoint.samplesPerPass = interval;
+            checkpoint.save(options.checkpoint);
+        }
+        if (converged) {
+            break;
+        }
+    }
+    if (quality && quality->lastSamples != pt.numSamplesAccumulated) {
+        quality->record(stats.seconds, pt.numSamplesAccumulated, pt.image());
+    }
+    printf("Rendering took %.3f sec (%.1f spp avg, %.2f Mrays/sec)\n", stats.seconds,
+           double(stats.samples) / (double(pt.width) * pt.height), stats.raysPerSec() / 1e6);
+    if (!options.partial.empty()) {
+        pt.partial(options.firstSample).save(options.partial);
+    }
+    vector<glm::vec3> pixels = options.denoise ? Denoiser().denoise(pt.denoiserInput()) : pt.image();
+    writeImage(options.output, pixels, pt.width, pt.height);
+}
+
+// Writes the zones of core/Profiler.h to prefix.folded and prefix.json.
+void writeCpuProfile(const Options &options) {
+    if (options.cpuProfile.empty()) {
+        return;
+    }
+#ifdef RENDERER_PROFILE
+    Profiler::printSummary();
+    Profiler::writeFolded(options.cpuProfile + ".folded");
+    Profiler::writeChromeTrace(options.cpuProfile + ".json");
+#else
+    fprintf(stderr, "--cpu-profile needs a build with -DRENDERER_PROFILE=ON.\n");
+#endif
+}
 
 int main(int argc, char **argv) {
+    Options options = parseOptions(argc, argv);
+    if (options.cpu) {
+        renderCpu(options);
+        writeCpuProfile(options);
+        return 0;
+    }
     Shader::shadersDir = filesystem::path(argv[0]).parent_path() / "shaders";
-    shared_ptr<Window> window = make_shared<Window>(640, 480, "window");
+    if (options.headless) {
+        shared_ptr<Window> window = make_shared<Window>(options.width, options.height, "window", false);
+        PathTracer pt(window);
+        pt.setScene(loadScene(options));
+        pt.numSamples = options.numSamples;
+        pt.convergenceThreshold = options.threshold;
+        pt.passBudgetMs = options.passBudgetMs > 0.0 ? options.passBudgetMs : 500.0;
+        pt.samplesPerPass = options.samplesPerPass;
+        pt.samplerType = options.sampler;
+        pt.denoise = options.denoise;
+        pt.checkpointPath = options.checkpoint;
+        pt.checkpointInterval = options.checkpointInterval;
+        pt.firstSample = options.firstSample;
+        pt.seed = options.seed;
+        pt.partialPath = options.partial;
+        pt.gpuProfilePath = options.gpuProfile;
+        pt.referencePath = options.reference;
+        pt.qualityLogPath = options.qualityLog;
+        pt.renderToFile(options.width, options.height, options.output);
+        writeCpuProfile(options);
+        return 0;
+    }
+    shared_ptr<Window> window = make_shared<Window>(options.width, options.height, "window");
     PathTracer pt(window);
+    pt.setScene(loadScene(options));
+    pt.numSamples = options.numSamples;
+    pt.convergenceThreshold = options.threshold;
+    pt.passBudgetMs = options.passBudgetMs > 0.0 ? options.passBudgetMs : 30.0;
+    pt.samplesPerPass = options.samplesPerPass;
+    pt.samplerType = options.sampler;
+    pt.checkpointPath = options.checkpoint;
+    pt.checkpointInterval = options.checkpointInterval;
+    pt.firstSample = options.firstSample;
+    pt.seed = options.seed;
+    pt.gpuProfilePath = options.gpuProfile;
     pt.render();
+    writeCpuProfile(options);
 }
-
@@ -0,0 +1,351 @@
+#include "BVH.h"
+#include "core/Profiler.h"
+#include "core/Timer.h"
+
+#include <atomic>
+
+namespace {
+
+const int BIN_N = 16;
+// Ranges larger than this are split off into their own OpenMP task.
+const unsigned int PARALLEL_THRESHOLD = 4096;
+
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    void grow(const glm::vec3 &p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void grow(const AABB &b) {
+        min = glm::min(min, b.min);
+        max = glm::max(max, b.max);
+    }
+
+    float area() const {
+        glm::vec3 e = max - min;
+        if (e.x < 0.0f) {
+            return 0.0f;
+        }
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+};
+
+float nodeArea(const BVHNode &node) {
+    AABB box;
+    box.min = node.boundsMin;
+    box.max = node.boundsMax;
+    return box.area();
+}
+
+struct Builder {
+    BVH &bvh;
+    const vector<AABB> &triBounds;
+    const vector<glm::vec3> &centroids;
+    std::atomic<unsigned int> nodesUsed{2};
+
+    Builder(BVH &bvh, const vector<AABB> &triBounds, const vector<glm::vec3> &centroids)
+            : bvh(bvh), triBounds(triBounds), centroids(centroids) {
+    }
+
+    void makeLeaf(BVHNode &node, unsigned int first, unsigned int count) {
+        node.leftFirst = first;
+        node.triCount = count;
+    }
+
+    void build(unsigned int nodeId, unsigned int first, unsigned int count, int level) {
+        unsigned int *tris = bvh.triIndices.data() + first;
+        AABB bounds, centroidBounds;
+        for (unsigned int i = 0; i < count; i++) {
+            bounds.grow(triBounds[tris[i]]);
+            centroidBounds.grow(centroids[tris[i]]);
+        }
+        BVHNode &node = bvh.nodes[nodeId];
+        node.boundsMin = bounds.min;
+        node.boundsMax = bounds.max;
+        if (count <= 2 || level >= BVH::MAX_DEPTH) {
+            makeLeaf(node, first, count);
+            return;
+        }
+
+        // Bin the centroids along every axis and sweep for the cheapest split plane.
+        int bestAxis = -1, bestSplit = 0;
+        float bestCost = FLT_MAX;
+        const glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+        for (int axis = 0; axis < 3; axis++) {
+            if (extent[axis] <= 0.0f) {
+                continue;
+            }
+            AABB binBounds[BIN_N];
+            unsigned int binCount[BIN_N] = {};
+            const float scale = BIN_N / extent[axis];
+            for (unsigned int i = 0; i < count; i++) {
+                int b = min(int((centroids[tris[i]][axis] - centroidBounds.min[axis]) * scale), BIN_N - 1);
+                binBounds[b].grow(triBounds[tris[i]]);
+                binCount[b]++;
+            }
+            float rightArea[BIN_N - 1];
+            unsigned int rightCount[BIN_N - 1];
+            AABB right;
+            unsigned int rightSum = 0;
+            for (int b = BIN_N - 1; b > 0; b--) {
+                right.grow(binBounds[b]);
+                rightSum += binCount[b];
+                rightArea[b - 1] = right.area();
+                rightCount[b - 1] = rightSum;
+            }
+            AABB left;
+            unsigned int leftSum = 0;
+            for (int b = 0; b < BIN_N - 1; b++) {
+                left.grow(binBounds[b]);
+                leftSum += binCount[b];
+                if (leftSum == 0 || rightCount[b] == 0) {
+                    continue;
+                }
+                float cost = left.area() * leftSum + rightArea[b] * rightCount[b];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b + 1;
+                }
+            }
+        }
+
+        const float leafCost = bvh.intersectionCost * count;
+        const float splitCost = bvh.traversalCost + bvh.intersectionCost * bestCost / max(bounds.area(), FLT_MIN);
+        if (count <= (unsigned int)bvh.maxLeafSize && (bestAxis < 0 || splitCost >= leafCost)) {
+            makeLeaf(node, first, count);
+            return;
+        }
+
+        unsigned int leftCount;
+        if (bestAxis >= 0) {
+            const float scale = BIN_N / extent[bestAxis];
+            const float minC = centroidBounds.min[bestAxis];
+            unsigned int *mid = std::partition(tris, tris + count, [&](unsigned int t) {
+                return min(int((centroids[t][bestAxis] - minC) * scale), BIN_N - 1) < bestSplit;
+            });
+            leftCount = (unsigned int)(mid - tris);
+        } else {
+            // All centroids coincide: split the range in half.
+            leftCount = count / 2;
+        }
+        if (leftCount == 0 || leftCount == count) {
+            leftCount = count / 2;
+        }
+
+        const unsigned int left = nodesUsed.fetch_add(2);
+        node.leftFirst = left;
+        node.triCount = 0;
+        if (count > PARALLEL_THRESHOLD) {
+#pragma omp task firstprivate(left, first, leftCount, level)
+            build(left, first, leftCount, level + 1);
+            build(left + 1, first + leftCount, count - leftCount, level + 1);
+#pragma omp taskwait
+        } else {
+            build(left, first, leftCount, level + 1);
+            build(left + 1, first + leftCount, count - leftCount, level + 1);
+        }
+    }
+};
+
+// Shear constants of the watertight ray/triangle test (Woop et al. 2013).
+struct WatertightRay {
+    int kx, ky, kz;
+    float Sx, Sy, Sz;
+
+    explicit WatertightRay(const glm::vec3 &dir) {
+        glm::vec3 a = glm::abs(dir);
+        kz = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+        kx = (kz + 1) % 3;
+        ky = (kx + 1) % 3;
+        if (dir[kz] < 0.0f) {
+            swap(kx, ky);
+        }
+        Sx = dir[kx] / dir[kz];
+        Sy = dir[ky] / dir[kz];
+        Sz = 1.0f / dir[kz];
+    }
+
+    bool intersect(const glm::vec3 &org, const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2,
+                   float tMin, float tMax, float &t) const {
+        const glm::vec3 A = v0 - org, B = v1 - org, C = v2 - org;
+        const float Ax = A[kx] - Sx * A[kz], Ay = A[ky] - Sy * A[kz];
+        const float Bx = B[kx] - Sx * B[kz], By = B[ky] - Sy * B[kz];
+        const float Cx = C[kx] - Sx * C[kz], Cy = C[ky] - Sy * C[kz];
+        float U = Cx * By - Cy * Bx;
+        float V = Ax * Cy - Ay * Cx;
+        float W = Bx * Ay - By * Ax;
+        if (U == 0.0f || V == 0.0f || W == 0.0f) {
+            U = float(double(Cx) * double(By) - double(Cy) * double(Bx));
+            V = float(double(Ax) * double(Cy) - double(Ay) * double(Cx));
+            W = float(double(Bx) * double(Ay) - double(By) * double(Ax));
+        }
+        if ((U < 0.0f || V < 0.0f || W < 0.0f) && (U > 0.0f || V > 0.0f || W > 0.0f)) {
+            return false;
+        }
+        const float det = U + V + W;
+        if (det == 0.0f) {
+            return false;
+        }
+        const float T = U * Sz * A[kz] + V * Sz * B[kz] + W * Sz * C[kz];
+        t = T / det;
+        return t > tMin && t < tMax;
+    }
+};
+
+// Entry distance of the ray into the box, or FLT_MAX if it misses within (tMin, tMax).
+float intersectBox(const BVHNode &node, const glm::vec3 &org, const glm::vec3 &invDir, float tMin, float tMax) {
+    glm::vec3 t0 = (node.boundsMin - org) * invDir;
+    glm::vec3 t1 = (node.boundsMax - org) * invDir;
+    glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+    float enter = max(max(tNear.x, tNear.y), max(tNear.z, tMin));
+    float exit = min(min(tFar.x, tFar.y), min(tFar.z, tMax));
+    return enter <= exit ? enter : FLT_MAX;
+}
+
+} // namespace
+
+void BVH::build(const TriMesh &mesh) {
+    PROFILE_SCOPE("BVH::build");
+    Timer timer;
+    timer.start();
+
+    const unsigned int faceN = mesh.faceN;
+    nodes.clear();
+    triIndices.resize(faceN);
+    if (faceN == 0) {
+        return;
+    }
+
+    vector<AABB> triBounds(faceN);
+    vector<glm::vec3> centroids(faceN);
+    {
+        PROFILE_SCOPE("triangle bounds");
+#pragma omp parallel for
+        for (int i = 0; i < (int)faceN; i++) {
+            for (int j = 0; j < 3; j++) {
+                triBounds[i].grow(mesh.vertices[mesh.verIndices[3 * i + j]]);
+            }
+            centroids[i] = (triBounds[i].min + triBounds[i].max) * 0.5f;
+            triIndices[i] = i;
+        }
+    }
+
+    vector<BVHNode, AlignedAllocator<BVHNode, 64>> buildNodes(2 * size_t(faceN) + 1);
+    nodes.swap(buildNodes);
+    Builder builder(*this, triBounds, centroids);
+    {
+        PROFILE_SCOPE("binned SAH");
+#pragma omp parallel
+#pragma omp single
+        builder.build(0, 0, faceN, 1);
+    }
+    const unsigned int nodeN = builder.nodesUsed.load();
+
+    // Depth-first relayout: makes the node order independent of task scheduling.
+    {
+        PROFILE_SCOPE("relayout");
+        buildNodes.swap(nodes);
+        nodes.assign(nodeN, BVHNode());
+        nodes[0] = buildNodes[0];
+        unsigned int next = 2;
+        vector<pair<unsigned int, int>> stack = {{0, 1}};
+        depth = 0;
+        leafN = 0;
+        while (!stack.empty()) {
+            auto [id, level] = stack.back();
+            stack.pop_back();
+            depth = max(depth, level);
+            BVHNode &node = nodes[id];
+            if (node.isLeaf()) {
+                leafN++;
+                continue;
+            }
+            const unsigned int oldLeft = node.leftFirst;
+            nodes[next] = buildNodes[oldLeft];
+            nodes[next + 1] = buildNodes[oldLeft + 1];
+            node.leftFirst = next;
+            stack.push_back({next + 1, level + 1});
+            stack.push_back({next, level + 1});
+            next += 2;
+        }
+    }
+
+    buildTime = timer.stop();
+    sahCost = computeSAHCost();
+    cout << "Building BVH took " << buildTime << " sec (" << nodeN << " nodes, " << leafN
+         << " leaves, depth " << depth << ", SAH cost " << sahCost << ")" << endl;
+}
+
+float BVH::computeSAHCost() const {
+    if (nodes.empty()) {
+        return 0.0f;
+    }
+    const float rootArea = max(nodeArea(nodes[0]), FLT_MIN);
+    double cost = 0.0;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (i == 1) {
+            continue;
+        }
+        const BVHNode &node = nodes[i];
+        const float relativeArea = nodeArea(node) / rootArea;
+        cost += node.isLeaf() ? relativeArea * intersectionCost * node.triCount : relativeArea * traversalCost;
+    }
+    return float(cost);
+}
+
+bool BVH::intersect(const TriMesh &mesh, const glm::vec3 &org, const glm::vec3 &dir,
+                    float &tHit, unsigned int &faceId, float tMin) const {
+    if (nodes.empty()) {
+        return false;
+    }
+    const WatertightRay ray(dir);
+    const glm::vec3 invDir = 1.0f / dir;
+    bool hit = false;
+    // A path from the root passes at most MAX_DEPTH - 1 inner nodes, each pushing one child.
+    unsigned int stack[MAX_DEPTH];
+    int stackSize = 0;
+    unsigned int id = 0;
+    if (intersectBox(nodes[0], org, invDir, tMin, tHit) == FLT_MAX) {
+        return false;
+    }
+    while (true) {
+        const BVHNode &node = nodes[id];
+        if (node.isLeaf()) {
+            for (unsigned int i = node.leftFirst; i < node.leftFirst + node.triCount; i++) {
+                const unsigned int f = triIndices[i];
+                float t;
+                if (ray.intersect(org, mesh.vertices[mesh.verIndices[3 * f + 0]], mesh.vertices[mesh.verIndices[3 * f + 1]],
+                                  mesh.vertices[mesh.verIndices[3 * f + 2]], tMin, tHit, t)) {
+                    tHit = t;
+                    faceId = f;
+                    hit = true;
+                }
+            }
+        } else {
+            unsigned int nearChild = node.leftFirst, farChild = node.leftFirst + 1;
+            float dNear = intersectBox(nodes[nearChild], org, invDir, tMin, tHit);
+            float dFar = intersectBox(nodes[farChild], org, invDir, tMin, tHit);
+            if (dFar < dNear) {
+                swap(nearChild, farChild);
+                swap(dNear, dFar);
+            }
+            if (dNear != FLT_MAX) {
+                if (dFar != FLT_MAX) {
+                    stack[stackSize++] = farChild;
+                }
+                id = nearChild;
+                continue;
+            }
+        }
+        // Pop the next subtree that can still contain a closer hit.
+        if (stackSize == 0) {
+            break;
+        }
+        id = stack[--stackSize];
+    }
+    return hit;
+}
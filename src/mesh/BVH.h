@@ -0,0 +1,63 @@
+#pragma once
+
+#ifndef BVH_H
+#define BVH_H
+
+#include "TriMesh.h"
+#include "core/AlignedAllocator.h"
+#include "core/common.h"
+
+// 32 bytes; the two children of a node are stored next to each other and start on an even
+// index, so a sibling pair shares one 64-byte cache line.
+struct alignas(32) BVHNode {
+    glm::vec3 boundsMin;
+    unsigned int leftFirst; // inner node: index of the left child (right = left + 1), leaf: first entry in triIndices
+    glm::vec3 boundsMax;
+    unsigned int triCount;  // 0 for inner nodes
+
+    bool isLeaf() const {
+        return triCount > 0;
+    }
+};
+static_assert(sizeof(BVHNode) == 32, "BVHNode must be 32 bytes");
+
+// Bounding volume hierarchy over the faces of a TriMesh, built with binned SAH.
+// Subtrees are built in parallel with OpenMP tasks; the nodes are relaid out in
+// depth-first order afterwards, so the result does not depend on the thread count.
+class BVH {
+public:
+    // Nodes at this depth (the root is at depth 1) are made leaves whatever their size, so
+    // traversal stacks of MAX_DEPTH entries (here and in render.frag) never overflow.
+    static const int MAX_DEPTH = 64;
+
+    vector<BVHNode, AlignedAllocator<BVHNode, 64>> nodes; // nodes[0] is the root, nodes[1] is unused padding
+    vector<unsigned int> triIndices;                      // face ids in leaf order
+
+    int maxLeafSize = 8;
+    float traversalCost = 1.0f;
+    float intersectionCost = 1.0f;
+
+    // Filled in by build().
+    double buildTime = 0.0;
+    float sahCost = 0.0f;
+    int depth = 0;
+    int leafN = 0;
+
+    BVH() = default;
+
+    explicit BVH(const TriMesh &mesh) {
+        build(mesh);
+    }
+
+    void build(const TriMesh &mesh);
+
+    // SAH cost of the tree relative to its root, with traversalCost / intersectionCost.
+    float computeSAHCost() const;
+
+    // Closest hit along org + t * dir with tMin < t < tHit (watertight ray/triangle test).
+    // On a hit tHit and faceId are updated.
+    bool intersect(const TriMesh &mesh, const glm::vec3 &org, const glm::vec3 &dir,
+                   float &tHit, unsigned int &faceId, float tMin = 0.0f) const;
+};
+
+#endif //BVH_H
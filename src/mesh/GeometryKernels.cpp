@@ -0,0 +1,523 @@
+#include "GeometryKernels.h"
+#include "core/Profiler.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define GEOMETRY_KERNELS_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define GEOMETRY_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace GeometryKernels;
+
+namespace {
+
+bool cpuHasAvx2() {
+#if !defined(GEOMETRY_KERNELS_AVX2)
+    return false;
+#elif defined(_MSC_VER)
+    // AVX2 in CPUID and the YMM state enabled by the OS.
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+Level &currentLevel() {
+    static Level level = detectLevel();
+    return level;
+}
+
+size_t paddedSize(size_t n) {
+    return (n + LANES - 1) / LANES * LANES;
+}
+
+// Splits [0, n) into BLOCK_SIZE blocks, reduces every block in parallel and combines the
+// results pairwise in a fixed tree, so the order of the operations only depends on n.
+template<typename Partial, typename BlockFunction, typename Combine>
+Partial reduceBlocks(size_t n, const Partial &identity, BlockFunction block, Combine combine) {
+    const int64_t blockN = int64_t((n + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    if (blockN == 0) {
+        return identity;
+    }
+    vector<Partial> partials(blockN);
+#pragma omp parallel for
+    for (int64_t b = 0; b < blockN; b++) {
+        partials[b] = block(size_t(b) * BLOCK_SIZE, min(n, size_t(b + 1) * BLOCK_SIZE));
+    }
+    for (int64_t stride = 1; stride < blockN; stride *= 2) {
+        const int64_t pairN = (blockN - stride + 2 * stride - 1) / (2 * stride);
+#pragma omp parallel for
+        for (int64_t p = 0; p < pairN; p++) {
+            const int64_t i = p * 2 * stride;
+            partials[i] = combine(partials[i], partials[i + stride]);
+        }
+    }
+    return partials[0];
+}
+
+struct Bounds {
+    float lo[3], hi[3];
+};
+
+const Bounds EMPTY_BOUNDS = {{FLT_MAX, FLT_MAX, FLT_MAX}, {-FLT_MAX, -FLT_MAX, -FLT_MAX}};
+
+// The comparisons skip NaNs the same way as _mm256_min_ps(value, bound).
+inline float minSkipNaN(float value, float bound) {
+    return value < bound ? value : bound;
+}
+
+inline float maxSkipNaN(float value, float bound) {
+    return value > bound ? value : bound;
+}
+
+Bounds combineBounds(const Bounds &a, const Bounds &b) {
+    Bounds bounds;
+    for (int j = 0; j < 3; j++) {
+        bounds.lo[j] = minSkipNaN(b.lo[j], a.lo[j]);
+        bounds.hi[j] = maxSkipNaN(b.hi[j], a.hi[j]);
+    }
+    return bounds;
+}
+
+Bounds boundsScalar(const float *const axes[3], size_t begin, size_t end) {
+    Bounds bounds = EMPTY_BOUNDS;
+    for (int j = 0; j < 3; j++) {
+        for (size_t i = begin; i < end; i++) {
+            bounds.lo[j] = minSkipNaN(axes[j][i], bounds.lo[j]);
+            bounds.hi[j] = maxSkipNaN(axes[j][i], bounds.hi[j]);
+        }
+    }
+    return bounds;
+}
+
+struct Sum {
+    double s[3];
+};
+
+Sum combineSums(const Sum &a, const Sum &b) {
+    return {{a.s[0] + b.s[0], a.s[1] + b.s[1], a.s[2] + b.s[2]}};
+}
+
+// The fixed order in which every version adds up its lanes.
+inline double sumLanes(const double lanes[LANES]) {
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+// begin and end are multiples of LANES; the padding is zero.
+Sum sumScalar(const float *const axes[3], size_t begin, size_t end) {
+    Sum sum;
+    for (int j = 0; j < 3; j++) {
+        double lanes[LANES] = {};
+        for (size_t i = begin; i < end; i += LANES) {
+            for (int k = 0; k < LANES; k++) {
+                lanes[k] += double(axes[j][i + k]);
+            }
+        }
+        sum.s[j] = sumLanes(lanes);
+    }
+    return sum;
+}
+
+void faceCentersScalar(const float *const axes[3], const unsigned int *indices, size_t begin, size_t end,
+                       glm::vec3 *centers) {
+    for (size_t f = begin; f < end; f++) {
+        const unsigned int *index = indices + 3 * f;
+        for (int j = 0; j < 3; j++) {
+            centers[f][j] = (axes[j][index[0]] + axes[j][index[1]] + axes[j][index[2]]) / 3.0f;
+        }
+    }
+}
+
+void faceNormalsScalar(const float *const axes[3], const unsigned int *indices, size_t begin, size_t end,
+                       glm::vec3 *normals, float *areas) {
+    const float *x = axes[0], *y = axes[1], *z = axes[2];
+    for (size_t f = begin; f < end; f++) {
+        const unsigned int i0 = indices[3 * f + 0], i1 = indices[3 * f + 1], i2 = indices[3 * f + 2];
+        const float ax = x[i1] - x[i0], ay = y[i1] - y[i0], az = z[i1] - z[i0];
+        const float bx = x[i2] - x[i1], by = y[i2] - y[i1], bz = z[i2] - z[i1];
+        const float cx = ay * bz - by * az, cy = az * bx - bz * ax, cz = ax * by - bx * ay;
+        const float length = sqrt(cx * cx + cy * cy + cz * cz);
+        if (normals) {
+            const float inverse = 1.0f / length;
+            normals[f] = glm::vec3(cx * inverse, cy * inverse, cz * inverse);
+        }
+        if (areas) {
+            areas[f] = 0.5f * length;
+        }
+    }
+}
+
+#ifdef GEOMETRY_KERNELS_AVX2
+
+AVX2_TARGET Bounds boundsAvx2(const float *const axes[3], size_t begin, size_t end) {
+    Bounds bounds = EMPTY_BOUNDS;
+    const size_t vectorEnd = begin + (end - begin) / LANES * LANES;
+    for (int j = 0; j < 3; j++) {
+        __m256 lo = _mm256_set1_ps(FLT_MAX), hi = _mm256_set1_ps(-FLT_MAX);
+        for (size_t i = begin; i < vectorEnd; i += LANES) {
+            const __m256 value = _mm256_load_ps(axes[j] + i);
+            lo = _mm256_min_ps(value, lo);
+            hi = _mm256_max_ps(value, hi);
+        }
+        alignas(32) float los[LANES], his[LANES];
+        _mm256_store_ps(los, lo);
+        _mm256_store_ps(his, hi);
+        for (int k = 0; k < LANES; k++) {
+            bounds.lo[j] = minSkipNaN(los[k], bounds.lo[j]);
+            bounds.hi[j] = maxSkipNaN(his[k], bounds.hi[j]);
+        }
+    }
+    return combineBounds(bounds, boundsScalar(axes, vectorEnd, end));
+}
+
+AVX2_TARGET Sum sumAvx2(const float *const axes[3], size_t begin, size_t end) {
+    Sum sum;
+    for (int j = 0; j < 3; j++) {
+        __m256d low = _mm256_setzero_pd(), high = _mm256_setzero_pd();
+        for (size_t i = begin; i < end; i += LANES) {
+            const __m256 value = _mm256_load_ps(axes[j] + i);
+            low = _mm256_add_pd(low, _mm256_cvtps_pd(_mm256_castps256_ps128(value)));
+            high = _mm256_add_pd(high, _mm256_cvtps_pd(_mm256_extractf128_ps(value, 1)));
+        }
+        alignas(32) double lanes[LANES];
+        _mm256_store_pd(lanes, low);
+        _mm256_store_pd(lanes + 4, high);
+        sum.s[j] = sumLanes(lanes);
+    }
+    return sum;
+}
+
+// Loads vertex `corner` of the next LANES faces: their indices, then x, y and z.
+AVX2_TARGET inline void gatherCorner(const float *const axes[3], const unsigned int *faceIndices, int corner,
+                                     __m256 &x, __m256 &y, __m256 &z) {
+    const __m256i stride = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    const __m256i index = _mm256_i32gather_epi32(reinterpret_cast<const int *>(faceIndices + corner), stride, 4);
+    x = _mm256_i32gather_ps(axes[0], index, 4);
+    y = _mm256_i32gather_ps(axes[1], index, 4);
+    z = _mm256_i32gather_ps(axes[2], index, 4);
+}
+
+AVX2_TARGET void faceCentersAvx2(const float *const axes[3], const unsigned int *indices, size_t begin, size_t end,
+                                 glm::vec3 *centers) {
+    const size_t vectorEnd = begin + (end - begin) / LANES * LANES;
+    const __m256 three = _mm256_set1_ps(3.0f);
+    for (size_t f = begin; f < vectorEnd; f += LANES) {
+        __m256 x0, y0, z0, x1, y1, z1, x2, y2, z2;
+        gatherCorner(axes, indices + 3 * f, 0, x0, y0, z0);
+        gatherCorner(axes, indices + 3 * f, 1, x1, y1, z1);
+        gatherCorner(axes, indices + 3 * f, 2, x2, y2, z2);
+        alignas(32) float cx[LANES], cy[LANES], cz[LANES];
+        _mm256_store_ps(cx, _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(x0, x1), x2), three));
+        _mm256_store_ps(cy, _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(y0, y1), y2), three));
+        _mm256_store_ps(cz, _mm256_div_ps(_mm256_add_ps(_mm256_add_ps(z0, z1), z2), three));
+        for (int k = 0; k < LANES; k++) {
+            centers[f + k] = glm::vec3(cx[k], cy[k], cz[k]);
+        }
+    }
+    faceCentersScalar(axes, indices, vectorEnd, end, centers);
+}
+
+AVX2_TARGET void faceNormalsAvx2(const float *const axes[3], const unsigned int *indices, size_t begin, size_t end,
+                                 glm::vec3 *normals, float *areas) {
+    const size_t vectorEnd = begin + (end - begin) / LANES * LANES;
+    const __m256 one = _mm256_set1_ps(1.0f), half = _mm256_set1_ps(0.5f);
+    for (size_t f = begin; f < vectorEnd; f += LANES) {
+        __m256 x0, y0, z0, x1, y1, z1, x2, y2, z2;
+        gatherCorner(axes, indices + 3 * f, 0, x0, y0, z0);
+        gatherCorner(axes, indices + 3 * f, 1, x1, y1, z1);
+        gatherCorner(axes, indices + 3 * f, 2, x2, y2, z2);
+        const __m256 ax = _mm256_sub_ps(x1, x0), ay = _mm256_sub_ps(y1, y0), az = _mm256_sub_ps(z1, z0);
+        const __m256 bx = _mm256_sub_ps(x2, x1), by = _mm256_sub_ps(y2, y1), bz = _mm256_sub_ps(z2, z1);
+        const __m256 cx = _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(by, az));
+        const __m256 cy = _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(bz, ax));
+        const __m256 cz = _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(bx, ay));
+        const __m256 length = _mm256_sqrt_ps(_mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy)), _mm256_mul_ps(cz, cz)));
+        if (normals) {
+            const __m256 inverse = _mm256_div_ps(one, length);
+            alignas(32) float nx[LANES], ny[LANES], nz[LANES];
+            _mm256_store_ps(nx, _mm256_mul_ps(cx, inverse));
+            _mm256_store_ps(ny, _mm256_mul_ps(cy, inverse));
+            _mm256_store_ps(nz, _mm256_mul_ps(cz, inverse));
+            for (int k = 0; k < LANES; k++) {
+                normals[f + k] = glm::vec3(nx[k], ny[k], nz[k]);
+            }
+        }
+        if (areas) {
+            _mm256_storeu_ps(areas + f, _mm256_mul_ps(half, length));
+        }
+    }
+    faceNormalsScalar(axes, indices, vectorEnd, end, normals, areas);
+}
+
+#endif // GEOMETRY_KERNELS_AVX2
+
+#ifdef GEOMETRY_KERNELS_NEON
+
+// Four floats of faces f .. f + 3, loaded one by one (NEON has no gather).
+inline float32x4_t gatherNeon(const float *axis, const unsigned int *indices, size_t f, int corner) {
+    const float values[4] = {axis[indices[3 * f + corner]], axis[indices[3 * f + 3 + corner]],
+                             axis[indices[3 * f + 6 + corner]], axis[indices[3 * f + 9 + corner]]};
+    return vld1q_f32(values);
+}
+
+Bounds boundsNeon(const float *const axes[3], size_t begin, size_t end) {
+    Bounds bounds = EMPTY_BOUNDS;
+    const size_t vectorEnd = begin + (end - begin) / 4 * 4;
+    for (int j = 0; j < 3; j++) {
+        float32x4_t lo = vdupq_n_f32(FLT_MAX), hi = vdupq_n_f32(-FLT_MAX);
+        for (size_t i = begin; i < vectorEnd; i += 4) {
+            const float32x4_t value = vld1q_f32(axes[j] + i);
+            // vminq_f32 would propagate NaNs.
+            lo = vbslq_f32(vcltq_f32(value, lo), value, lo);
+            hi = vbslq_f32(vcgtq_f32(value, hi), value, hi);
+        }
+        float los[4], his[4];
+        vst1q_f32(los, lo);
+        vst1q_f32(his, hi);
+        for (int k = 0; k < 4; k++) {
+            bounds.lo[j] = minSkipNaN(los[k], bounds.lo[j]);
+            bounds.hi[j] = maxSkipNaN(his[k], bounds.hi[j]);
+        }
+    }
+    return combineBounds(bounds, boundsScalar(axes, vectorEnd, end));
+}
+
+Sum sumNeon(const float *const axes[3], size_t begin, size_t end) {
+    Sum sum;
+    for (int j = 0; j < 3; j++) {
+        float64x2_t lanes01 = vdupq_n_f64(0.0), lanes23 = vdupq_n_f64(0.0);
+        float64x2_t lanes45 = vdupq_n_f64(0.0), lanes67 = vdupq_n_f64(0.0);
+        for (size_t i = begin; i < end; i += LANES) {
+            const float32x4_t low = vld1q_f32(axes[j] + i), high = vld1q_f32(axes[j] + i + 4);
+            lanes01 = vaddq_f64(lanes01, vcvt_f64_f32(vget_low_f32(low)));
+            lanes23 = vaddq_f64(lanes23, vcvt_high_f64_f32(low));
+            lanes45 = vaddq_f64(lanes45, vcvt_f64_f32(vget_low_f32(high)));
+            lanes67 = vaddq_f64(lanes67, vcvt_high_f64_f32(high));
+        }
+        double lanes[LANES];
+        vst1q_f64(lanes + 0, lanes01);
+        vst1q_f64(lanes + 2, lanes23);
+        vst1q_f64(lanes + 4, lanes45);
+        vst1q_f64(lanes + 6, lanes67);
+        sum.s[j] = sumLanes(lanes);
+    }
+    return sum;
+}
+
+void faceCentersNeon(const float *const axes[3], const unsigned int *indices, size_t begin, size_t end,
+                     glm::vec3 *centers) {
+    const size_t vectorEnd = begin + (end - begin) / 4 * 4;
+    const float32x4_t three = vdupq_n_f32(3.0f);
+    for (size_t f = begin; f < vectorEnd; f += 4) {
+        float c[3][4];
+        for (int j = 0; j < 3; j++) {
+            const float32x4_t sum = vaddq_f32(vaddq_f32(gatherNeon(axes[j], indices, f, 0),
+                                                        gatherNeon(axes[j], indices, f, 1)),
+                                              gatherNeon(axes[j], indices, f, 2));
+            vst1q_f32(c[j], vdivq_f32(sum, three));
+        }
+        for (int k = 0; k < 4; k++) {
+            centers[f + k] = glm::vec3(c[0][k], c[1][k], c[2][k]);
+        }
+    }
+    faceCentersScalar(axes, indices, vectorEnd, end, centers);
+}
+
+void faceNormalsNeon(const float *const axes[3], const unsigned int *indices, size_t begin, size_t end,
+                     glm::vec3 *normals, float *areas) {
+    const size_t vectorEnd = begin + (end - begin) / 4 * 4;
+    for (size_t f = begin; f < vectorEnd; f += 4) {
+        float32x4_t p[3][3];
+        for (int corner = 0; corner < 3; corner++) {
+            for (int j = 0; j < 3; j++) {
+                p[corner][j] = gatherNeon(axes[j], indices, f, corner);
+            }
+        }
+        const float32x4_t ax = vsubq_f32(p[1][0], p[0][0]), ay = vsubq_f32(p[1][1], p[0][1]), az = vsubq_f32(p[1][2], p[0][2]);
+        const float32x4_t bx = vsubq_f32(p[2][0], p[1][0]), by = vsubq_f32(p[2][1], p[1][1]), bz = vsubq_f32(p[2][2], p[1][2]);
+        const float32x4_t cx = vsubq_f32(vmulq_f32(ay, bz), vmulq_f32(by, az));
+        const float32x4_t cy = vsubq_f32(vmulq_f32(az, bx), vmulq_f32(bz, ax));
+        const float32x4_t cz = vsubq_f32(vmulq_f32(ax, by), vmulq_f32(bx, ay));
+        const float32x4_t length = vsqrtq_f32(vaddq_f32(vaddq_f32(vmulq_f32(cx, cx), vmulq_f32(cy, cy)), vmulq_f32(cz, cz)));
+        if (normals) {
+            const float32x4_t inverse = vdivq_f32(vdupq_n_f32(1.0f), length);
+            float n[3][4];
+            vst1q_f32(n[0], vmulq_f32(cx, inverse));
+            vst1q_f32(n[1], vmulq_f32(cy, inverse));
+            vst1q_f32(n[2], vmulq_f32(cz, inverse));
+            for (int k = 0; k < 4; k++) {
+                normals[f + k] = glm::vec3(n[0][k], n[1][k], n[2][k]);
+            }
+        }
+        if (areas) {
+            vst1q_f32(areas + f, vmulq_f32(vdupq_n_f32(0.5f), length));
+        }
+    }
+    faceNormalsScalar(axes, indices, vectorEnd, end, normals, areas);
+}
+
+#endif // GEOMETRY_KERNELS_NEON
+
+// Runs the per-face kernel of the current level over all faces in parallel.
+template<typename Scalar, typename Avx2, typename Neon>
+void forFaces(size_t faceN, Scalar scalar, Avx2 avx2, Neon neon) {
+    const int64_t blockN = int64_t((faceN + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    const Level level = currentLevel();
+#pragma omp parallel for
+    for (int64_t b = 0; b < blockN; b++) {
+        const size_t begin = size_t(b) * BLOCK_SIZE, end = min(faceN, size_t(b + 1) * BLOCK_SIZE);
+        if (level == AVX2) {
+            avx2(begin, end);
+        } else if (level == NEON) {
+            neon(begin, end);
+        } else {
+            scalar(begin, end);
+        }
+    }
+}
+
+} // namespace
+
+void PositionsSoA::build(const vector<glm::vec3> &positions) {
+    PROFILE_SCOPE("PositionsSoA::build");
+    size = positions.size();
+    const size_t padded = paddedSize(size);
+    x.resize(padded);
+    y.resize(padded);
+    z.resize(padded);
+#pragma omp parallel for
+    for (int64_t i = 0; i < int64_t(padded); i++) {
+        const glm::vec3 p = i < int64_t(size) ? positions[i] : glm::vec3(0.0f);
+        x[i] = p.x;
+        y[i] = p.y;
+        z[i] = p.z;
+    }
+}
+
+Level GeometryKernels::detectLevel() {
+#if defined(GEOMETRY_KERNELS_NEON)
+    // NEON is part of ARMv8-A.
+    return NEON;
+#else
+    return cpuHasAvx2() ? AVX2 : SCALAR;
+#endif
+}
+
+Level GeometryKernels::level() {
+    return currentLevel();
+}
+
+Level GeometryKernels::setLevel(Level level) {
+    const Level best = detectLevel();
+    currentLevel() = level == best ? level : SCALAR;
+    return currentLevel();
+}
+
+const char *GeometryKernels::levelName(Level level) {
+    switch (level) {
+        case AVX2: return "avx2";
+        case NEON: return "neon";
+        default: return "scalar";
+    }
+}
+
+void GeometryKernels::bounds(const PositionsSoA &positions, glm::vec3 &minPoint, glm::vec3 &maxPoint) {
+    PROFILE_SCOPE("GeometryKernels::bounds");
+    const float *const axes[3] = {positions.x.data(), positions.y.data(), positions.z.data()};
+    const Level level = currentLevel();
+    const Bounds bounds = reduceBlocks(positions.size, EMPTY_BOUNDS, [&](size_t begin, size_t end) {
+#ifdef GEOMETRY_KERNELS_AVX2
+        if (level == AVX2) {
+            return boundsAvx2(axes, begin, end);
+        }
+#endif
+#ifdef GEOMETRY_KERNELS_NEON
+        if (level == NEON) {
+            return boundsNeon(axes, begin, end);
+        }
+#endif
+        return boundsScalar(axes, begin, end);
+    }, combineBounds);
+    minPoint = glm::vec3(bounds.lo[0], bounds.lo[1], bounds.lo[2]);
+    maxPoint = glm::vec3(bounds.hi[0], bounds.hi[1], bounds.hi[2]);
+}
+
+glm::dvec3 GeometryKernels::centroid(const PositionsSoA &positions) {
+    PROFILE_SCOPE("GeometryKernels::centroid");
+    if (positions.size == 0) {
+        return glm::dvec3(0.0);
+    }
+    const float *const axes[3] = {positions.x.data(), positions.y.data(), positions.z.data()};
+    const Level level = currentLevel();
+    // Over the zero padding, so every block is whole vectors.
+    const Sum sum = reduceBlocks(paddedSize(positions.size), Sum{{0.0, 0.0, 0.0}}, [&](size_t begin, size_t end) {
+#ifdef GEOMETRY_KERNELS_AVX2
+        if (level == AVX2) {
+            return sumAvx2(axes, begin, end);
+        }
+#endif
+#ifdef GEOMETRY_KERNELS_NEON
+        if (level == NEON) {
+            return sumNeon(axes, begin, end);
+        }
+#endif
+        return sumScalar(axes, begin, end);
+    }, combineSums);
+    return glm::dvec3(sum.s[0], sum.s[1], sum.s[2]) / double(positions.size);
+}
+
+void GeometryKernels::faceCenters(const PositionsSoA &positions, const unsigned int *indices, size_t faceN,
+                                  glm::vec3 *centers) {
+    PROFILE_SCOPE("GeometryKernels::faceCenters");
+    const float *const axes[3] = {positions.x.data(), positions.y.data(), positions.z.data()};
+    forFaces(faceN, [&](size_t begin, size_t end) {
+        faceCentersScalar(axes, indices, begin, end, centers);
+    }, [&](size_t begin, size_t end) {
+#ifdef GEOMETRY_KERNELS_AVX2
+        faceCentersAvx2(axes, indices, begin, end, centers);
+#endif
+    }, [&](size_t begin, size_t end) {
+#ifdef GEOMETRY_KERNELS_NEON
+        faceCentersNeon(axes, indices, begin, end, centers);
+#endif
+    });
+}
+
+void GeometryKernels::faceNormals(const PositionsSoA &positions, const unsigned int *indices, size_t faceN,
+                                  glm::vec3 *normals, float *areas) {
+    PROFILE_SCOPE("GeometryKernels::faceNormals");
+    const float *const axes[3] = {positions.x.data(), positions.y.data(), positions.z.data()};
+    forFaces(faceN, [&](size_t begin, size_t end) {
+        faceNormalsScalar(axes, indices, begin, end, normals, areas);
+    }, [&](size_t begin, size_t end) {
+#ifdef GEOMETRY_KERNELS_AVX2
+        faceNormalsAvx2(axes, indices, begin, end, normals, areas);
+#endif
+    }, [&](size_t begin, size_t end) {
+#ifdef GEOMETRY_KERNELS_NEON
+        faceNormalsNeon(axes, indices, begin, end, normals, areas);
+#endif
+    });
+}
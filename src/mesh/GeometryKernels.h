@@ -0,0 +1,59 @@
+#pragma once
+
+#ifndef GEOMETRY_KERNELS_H
+#define GEOMETRY_KERNELS_H
+
+#include "core/AlignedAllocator.h"
+#include "core/common.h"
+
+// Positions as separate x, y and z arrays, 64-byte aligned and zero-padded to a multiple of
+// GeometryKernels::LANES, so that every vector load of a kernel is aligned and in bounds.
+struct PositionsSoA {
+    vector<float, AlignedAllocator<float, 64>> x, y, z;
+    size_t size = 0;
+
+    void build(const vector<glm::vec3> &positions);
+};
+
+// Mesh reductions and per-face kernels over PositionsSoA, with AVX2 (x86-64) and NEON (ARM64)
+// versions chosen at runtime and a scalar fallback.
+//
+// All versions run the same operations in the same order: sums are kept in LANES partial
+// sums (element i goes to lane i % LANES) over blocks of BLOCK_SIZE elements, and the block
+// results are combined in a fixed pairwise tree. Results therefore do not depend on the number
+// of threads, and are bitwise equal across versions unless the compiler contracts the scalar
+// code into FMAs (as it may on ARM64). The per-face kernels match glm::normalize and friends.
+namespace GeometryKernels {
+    enum Level {
+        SCALAR,
+        AVX2,
+        NEON,
+    };
+
+    const int LANES = 8;
+    const size_t BLOCK_SIZE = 1 << 14;
+
+    // The best level of this CPU; used unless setLevel() picks another.
+    Level detectLevel();
+    Level level();
+    // Falls back to SCALAR if the CPU doesn't support level; returns the level in use.
+    Level setLevel(Level level);
+    const char *levelName(Level level);
+
+    // Component-wise minimum and maximum of the positions; FLT_MAX and -FLT_MAX if there are
+    // none. NaNs are skipped.
+    void bounds(const PositionsSoA &positions, glm::vec3 &minPoint, glm::vec3 &maxPoint);
+
+    // Mean of the positions, summed in double.
+    glm::dvec3 centroid(const PositionsSoA &positions);
+
+    // (p0 + p1 + p2) / 3 of every face; indices has three entries per face.
+    void faceCenters(const PositionsSoA &positions, const unsigned int *indices, size_t faceN, glm::vec3 *centers);
+
+    // Unit normal of cross(p1 - p0, p2 - p1) and the area of every face. Either output may be
+    // null.
+    void faceNormals(const PositionsSoA &positions, const unsigned int *indices, size_t faceN, glm::vec3 *normals,
+                     float *areas);
+} // namespace GeometryKernels
+
+#endif //GEOMETRY_KERNELS_H
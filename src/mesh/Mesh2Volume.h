@@ -4,6 +4,7 @@
 #define MESH2VOLUME
 
 #include "opengl-wrapper/FrameBufferObject.h"
+#include "opengl-wrapper/GpuProfiler.h"
 #include "opengl-wrapper/Shader.h"
 #include "opengl-wrapper/Texture2D.h"
 #include "opengl-wrapper/Texture2DArray.h"
@@ -32,6 +33,10 @@ private:
 	float zNear;
 
 public:
+	// If enabled, times the rasterization and the readback of every slice and prints a summary
+	// after generateVolume().
+	GpuProfiler profiler;
+
 	Mesh2Volume(const int sizeX, const int sizeY, const int sizeZ, float resolution, shared_ptr<TriMesh> mesh, shared_ptr<Window> window)
 		: window(window),
 		mesh(mesh),
@@ -45,7 +50,7 @@ public:
 
 	void initialize() {
 		crossSection_shader.create(crossSection_vert_file, crossSection_frag_file);
-		mesh->computeAABB();
+		mesh->updateAABB();
 		center = mesh->centerAABB;
 		zFar = max(size[0], max(size[1], size[2])) * resolution + 10.0f;
 		zNear = 0.1f;
@@ -78,14 +83,19 @@ public:
 			glDisable(GL_DEPTH_TEST);
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 			glEnable(GL_COLOR_LOGIC_OP);
+			profiler.beginFrame();
+			profiler.begin("cross section");
 			crossSection_shader.bind();
 			crossSection_shader.set_uniform_value(projMat * viewMat * modelMat, "u_mvpMat");
-			vao.draw(FLAT_SHADING);
+			vao.draw(FLAT_SHADING, crossSection_shader);
 			crossSection_shader.release();
+			profiler.end();
 			glEnable(GL_DEPTH_TEST);
 			glDisable(GL_COLOR_LOGIC_OP);
+			profiler.begin("readback");
 			glReadBuffer(GL_COLOR_ATTACHMENT0);
 			glReadPixels(0, 0, size[0], size[1], GL_RED, GL_UNSIGNED_BYTE, buf);
+			profiler.end();
 #pragma omp parallel for
 			for (int i = 0; i < int(size[0]) * int(size[1]); i++) {
 				if (buf[i] > 0)buf[i] = 1;
@@ -97,6 +107,9 @@ public:
 		fbo.release();
 
 		cout << "Generating volume took " << timer.stop() << " sec" << endl;
+		if (profiler.enabled) {
+			profiler.printSummary();
+		}
 
 		return volume;
 	}
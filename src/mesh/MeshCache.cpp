@@ -0,0 +1,236 @@
+#include "MeshCache.h"
+#include "core/MappedFile.h"
+#include "core/Profiler.h"
+
+namespace {
+
+const char MESH_CACHE_MAGIC[8] = {'T', 'M', 'E', 'S', 'H', '\0', '\0', '\0'};
+const size_t MESH_CACHE_ALIGNMENT = 64;
+
+bool readHeader(const string &cachePath, MeshCacheHeader &header) {
+    ifstream file(cachePath, ios::binary);
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    return !file.fail() && memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+           header.version == MESH_CACHE_VERSION;
+}
+
+struct SectionWriter {
+    ofstream &file;
+    MeshCacheHeader &header;
+    size_t offset = sizeof(MeshCacheHeader);
+
+    template<typename T, typename Allocator>
+    void write(MeshCacheSection section, const vector<T, Allocator> &data) {
+        const size_t bytes = sizeof(T) * data.size();
+        if (bytes == 0) {
+            return;
+        }
+        static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+        const size_t padding = (MESH_CACHE_ALIGNMENT - offset % MESH_CACHE_ALIGNMENT) % MESH_CACHE_ALIGNMENT;
+        file.write(zeros, streamsize(padding));
+        offset += padding;
+        header.sections[section][0] = offset;
+        header.sections[section][1] = bytes;
+        file.write(reinterpret_cast<const char *>(data.data()), streamsize(bytes));
+        offset += bytes;
+    }
+};
+
+struct SectionReader {
+    const string &cachePath;
+    const MeshCacheHeader &header;
+    const MappedFile &file;
+
+    // Exits if the section doesn't fit the file or doesn't hold expectedCount elements
+    // (SIZE_MAX: any number); empty sections give an empty out.
+    template<typename T, typename Allocator>
+    void read(MeshCacheSection section, vector<T, Allocator> &out, size_t expectedCount) const {
+        const uint64_t offset = header.sections[section][0];
+        const uint64_t bytes = header.sections[section][1];
+        if (offset % MESH_CACHE_ALIGNMENT != 0 || bytes % sizeof(T) != 0 || offset > file.size() ||
+            bytes > file.size() - offset || (expectedCount != SIZE_MAX && bytes != 0 && bytes / sizeof(T) != expectedCount)) {
+            damaged();
+        }
+        const T *begin = reinterpret_cast<const T *>(file.data() + offset);
+        out.assign(begin, begin + bytes / sizeof(T));
+    }
+
+    void readBvh(BVH &bvh) const {
+        read(MESH_CACHE_BVH_NODES, bvh.nodes, SIZE_MAX);
+        read(MESH_CACHE_BVH_TRI_INDICES, bvh.triIndices, header.faceN);
+        if (bvh.nodes.empty() != bvh.triIndices.empty()) {
+            damaged();
+        }
+        bvh.depth = header.bvhDepth;
+        bvh.leafN = header.bvhLeafN;
+        bvh.maxLeafSize = header.bvhMaxLeafSize;
+        bvh.sahCost = header.bvhSahCost;
+        bvh.buildTime = 0.0;
+    }
+
+    void damaged() const {
+        fprintf(stderr, "Mesh cache \"%s\" is damaged; delete it to rebuild it.\n", cachePath.c_str());
+        exit(1);
+    }
+};
+
+} // namespace
+
+bool MeshCache::isFresh(const string &cachePath, const string &sourcePath) {
+    error_code error;
+    const auto cacheTime = filesystem::last_write_time(cachePath, error);
+    if (error) {
+        return false;
+    }
+    const auto sourceTime = filesystem::last_write_time(sourcePath, error);
+    if (error || cacheTime < sourceTime) {
+        return false;
+    }
+    const uintmax_t sourceSize = filesystem::file_size(sourcePath, error);
+    MeshCacheHeader header;
+    return !error && readHeader(cachePath, header) && header.sourceSize == sourceSize;
+}
+
+bool MeshCache::save(const string &cachePath, const TriMesh &mesh, const BVH *bvh, const string &sourcePath) {
+    PROFILE_SCOPE("MeshCache::save");
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.verN = mesh.verN;
+    header.faceN = mesh.faceN;
+    header.uvN = mesh.uvN;
+    header.uvfaceN = mesh.uvfaceN;
+    header.derived = mesh.freshDerived() & (DERIVED_FACE_NORMALS | DERIVED_FACE_CENTERS | DERIVED_VER_NORMALS | DERIVED_AABB);
+    if (mesh.isRenderOrderOptimized()) {
+        header.derived |= MESH_CACHE_RENDER_ORDER;
+    }
+    if (header.derived & DERIVED_AABB) {
+        for (int j = 0; j < 3; j++) {
+            header.minPointAABB[j] = mesh.minPointAABB[j];
+            header.maxPointAABB[j] = mesh.maxPointAABB[j];
+        }
+    }
+    if (!sourcePath.empty()) {
+        error_code error;
+        header.sourceSize = filesystem::file_size(sourcePath, error);
+    }
+    const bool hasBvh = bvh && !bvh->nodes.empty();
+    if (hasBvh) {
+        header.bvhDepth = bvh->depth;
+        header.bvhLeafN = bvh->leafN;
+        header.bvhMaxLeafSize = bvh->maxLeafSize;
+        header.bvhSahCost = bvh->sahCost;
+    }
+
+    // Written to a temporary file first, so readers never see a partial cache.
+    const string tmpPath = cachePath + ".tmp";
+    {
+        ofstream file(tmpPath, ios::binary | ios::trunc);
+        if (file.fail()) {
+            fprintf(stderr, "Can't write mesh cache \"%s\".\n", tmpPath.c_str());
+            return false;
+        }
+        // The section table is only known at the end; the header is rewritten then.
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        SectionWriter writer{file, header};
+        writer.write(MESH_CACHE_VERTICES, mesh.vertices);
+        writer.write(MESH_CACHE_VER_INDICES, mesh.verIndices);
+        // Area weighted, as computeVerNormals() makes them by default.
+        if ((header.derived & DERIVED_VER_NORMALS) && mesh.verNormalsWeighting == AREA_WEIGHTED) {
+            writer.write(MESH_CACHE_VER_NORMALS, mesh.verNormals);
+        } else {
+            header.derived &= ~DERIVED_VER_NORMALS;
+        }
+        if (header.derived & DERIVED_FACE_NORMALS) {
+            writer.write(MESH_CACHE_FACE_NORMALS, mesh.faceNormals);
+        }
+        if (header.derived & DERIVED_FACE_CENTERS) {
+            writer.write(MESH_CACHE_FACE_CENTERS, mesh.faceCenters);
+        }
+        writer.write(MESH_CACHE_UVS, mesh.uvs);
+        writer.write(MESH_CACHE_UV_INDICES, mesh.uvIndices);
+        writer.write(MESH_CACHE_NORMALS, mesh.normals);
+        writer.write(MESH_CACHE_NORMAL_INDICES, mesh.normalIndices);
+        if (hasBvh) {
+            writer.write(MESH_CACHE_BVH_NODES, bvh->nodes);
+            writer.write(MESH_CACHE_BVH_TRI_INDICES, bvh->triIndices);
+        }
+        file.seekp(0);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.flush();
+        if (file.fail()) {
+            fprintf(stderr, "Can't write mesh cache \"%s\".\n", tmpPath.c_str());
+            file.close();
+            filesystem::remove(tmpPath);
+            return false;
+        }
+    }
+    error_code error;
+    filesystem::rename(tmpPath, cachePath, error);
+    if (error) {
+        fprintf(stderr, "Can't rename mesh cache \"%s\": %s\n", tmpPath.c_str(), error.message().c_str());
+        filesystem::remove(tmpPath, error);
+        return false;
+    }
+    return true;
+}
+
+bool MeshCache::load(const string &cachePath, TriMesh &mesh, BVH *bvh) {
+    PROFILE_SCOPE("MeshCache::load");
+    MeshCacheHeader header;
+    if (!readHeader(cachePath, header)) {
+        return false;
+    }
+    MappedFile file(cachePath);
+    const SectionReader reader{cachePath, header, file};
+    reader.read(MESH_CACHE_VERTICES, mesh.vertices, header.verN);
+    reader.read(MESH_CACHE_VER_INDICES, mesh.verIndices, 3 * size_t(header.faceN));
+    reader.read(MESH_CACHE_VER_NORMALS, mesh.verNormals, header.verN);
+    reader.read(MESH_CACHE_FACE_NORMALS, mesh.faceNormals, header.faceN);
+    reader.read(MESH_CACHE_FACE_CENTERS, mesh.faceCenters, header.faceN);
+    reader.read(MESH_CACHE_UVS, mesh.uvs, header.uvN);
+    reader.read(MESH_CACHE_UV_INDICES, mesh.uvIndices, 3 * size_t(header.uvfaceN));
+    reader.read(MESH_CACHE_NORMALS, mesh.normals, SIZE_MAX);
+    reader.read(MESH_CACHE_NORMAL_INDICES, mesh.normalIndices, 3 * size_t(header.faceN));
+    mesh.verN = header.verN;
+    mesh.faceN = header.faceN;
+    mesh.uvN = header.uvN;
+    mesh.uvfaceN = header.uvfaceN;
+    if (mesh.vertices.size() != mesh.verN || mesh.verIndices.size() != 3 * size_t(mesh.faceN) ||
+        ((header.derived & DERIVED_VER_NORMALS) && mesh.verNormals.size() != mesh.verN) ||
+        ((header.derived & DERIVED_FACE_NORMALS) && mesh.faceNormals.size() != mesh.faceN) ||
+        ((header.derived & DERIVED_FACE_CENTERS) && mesh.faceCenters.size() != mesh.faceN)) {
+        reader.damaged();
+    }
+    if (header.derived & DERIVED_AABB) {
+        for (int j = 0; j < 3; j++) {
+            mesh.minPointAABB[j] = header.minPointAABB[j];
+            mesh.maxPointAABB[j] = header.maxPointAABB[j];
+        }
+        mesh.centerAABB = (mesh.minPointAABB + mesh.maxPointAABB) / 2.0f;
+    }
+    // The mesh may have been used before; everything not in the file is stale now.
+    mesh.markModified();
+    mesh.releaseDerived(DERIVED_VERTEX_FACES);
+    mesh.verNormalsWeighting = AREA_WEIGHTED;
+    mesh.setFresh(header.derived & DERIVED_ALL);
+    if (header.derived & MESH_CACHE_RENDER_ORDER) {
+        mesh.renderOrderGeneration = mesh.generation;
+    }
+
+    if (bvh) {
+        reader.readBvh(*bvh);
+    }
+    return true;
+}
+
+bool MeshCache::loadBvh(const string &cachePath, BVH &bvh) {
+    MeshCacheHeader header;
+    if (!readHeader(cachePath, header)) {
+        return false;
+    }
+    MappedFile file(cachePath);
+    SectionReader{cachePath, header, file}.readBvh(bvh);
+    return true;
+}
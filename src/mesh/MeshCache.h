@@ -0,0 +1,75 @@
+#pragma once
+
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "BVH.h"
+#include "TriMesh.h"
+#include "core/common.h"
+
+// Binary mesh container written by TriMeshLoader next to the source file (source + ".tmesh").
+// The arrays are stored exactly as TriMesh and BVH hold them, so loading is a header check
+// and one copy per array out of a memory mapping.
+//
+// File layout, native byte order (little endian):
+//   MeshCacheHeader                     256 bytes
+//   sections[MESH_CACHE_SECTION_N]      each starts at a multiple of 64 bytes; empty ones
+//                                       have offset 0 and bytes 0
+//
+// Derived data (normals, face centers, AABB) is only stored if it was up to date when saving;
+// MeshCacheHeader::derived tells which, and whether the faces and vertices are in the order of
+// TriMesh::optimizeRenderOrder() (MESH_CACHE_RENDER_ORDER).
+//
+// Bump MESH_CACHE_VERSION whenever the layout or the meaning of a section changes; caches
+// with another version are rebuilt.
+const uint32_t MESH_CACHE_VERSION = 3;
+const char MESH_CACHE_EXTENSION[] = ".tmesh";
+// Flag of MeshCacheHeader::derived above the TriMeshDerived bits.
+const uint32_t MESH_CACHE_RENDER_ORDER = 1u << 31;
+
+enum MeshCacheSection {
+    MESH_CACHE_VERTICES,        // glm::vec3[verN]
+    MESH_CACHE_VER_INDICES,     // uint32[3 * faceN]
+    MESH_CACHE_VER_NORMALS,     // glm::vec3[verN]
+    MESH_CACHE_FACE_NORMALS,    // glm::vec3[faceN]
+    MESH_CACHE_FACE_CENTERS,    // glm::vec3[faceN]
+    MESH_CACHE_UVS,             // glm::vec2[]
+    MESH_CACHE_UV_INDICES,      // uint32[]
+    MESH_CACHE_NORMALS,         // glm::vec3[]
+    MESH_CACHE_NORMAL_INDICES,  // uint32[]
+    MESH_CACHE_BVH_NODES,       // BVHNode[]
+    MESH_CACHE_BVH_TRI_INDICES, // uint32[faceN]
+    MESH_CACHE_SECTION_N,
+};
+
+struct MeshCacheHeader {
+    char magic[8];              // "TMESH\0\0\0"
+    uint32_t version;
+    uint32_t verN, faceN, uvN, uvfaceN;
+    int32_t bvhDepth, bvhLeafN, bvhMaxLeafSize;
+    float bvhSahCost;
+    uint32_t derived;           // TriMeshDerived mask of the stored derived data | MESH_CACHE_RENDER_ORDER
+    float minPointAABB[3], maxPointAABB[3];
+    uint64_t sourceSize;        // bytes of the source file, to notice edits within the mtime resolution
+    uint64_t sections[MESH_CACHE_SECTION_N][2]; // offset, bytes
+};
+static_assert(sizeof(MeshCacheHeader) == 256, "MeshCacheHeader must be 256 bytes");
+
+namespace MeshCache {
+    // True if cachePath exists, is at least as new as sourcePath and was made from a file of
+    // its size with the current version.
+    bool isFresh(const string &cachePath, const string &sourcePath);
+
+    // Writes mesh with its up to date derived data and, if given and built, bvh. sourcePath may be empty. Returns false (with a
+    // message) if the file can't be written; the cache is only an optimization.
+    bool save(const string &cachePath, const TriMesh &mesh, const BVH *bvh, const string &sourcePath);
+
+    // Returns false if the file is missing or was written with another version; exits if it is
+    // damaged. bvh is filled if the cache contains one and left empty otherwise.
+    bool load(const string &cachePath, TriMesh &mesh, BVH *bvh);
+
+    // Only the BVH sections of load(); bvh is left empty if the cache has none.
+    bool loadBvh(const string &cachePath, BVH &bvh);
+} // namespace MeshCache
+
+#endif //MESH_CACHE_H
@@ -0,0 +1,252 @@
+#include "MeshOptimizer.h"
+#include "VertexFaceAdjacency.h"
+#include "core/Profiler.h"
+
+namespace {
+
+// FIFO post-transform cache: a vertex is a hit if it was inserted less than size misses ago.
+struct FifoCache {
+    vector<unsigned int> insertedAt;
+    unsigned int size;
+    unsigned int time;
+
+    FifoCache(unsigned int verN, unsigned int size) : insertedAt(verN, 0), size(size), time(size + 1) {}
+
+    void reset() {
+        // Everything inserted so far is out of the cache.
+        time += size + 1;
+    }
+
+    // Number of misses of one face.
+    unsigned int face(const unsigned int *index) {
+        unsigned int misses = 0;
+        for (int k = 0; k < 3; k++) {
+            if (time - insertedAt[index[k]] > size) {
+                insertedAt[index[k]] = time++;
+                misses++;
+            }
+        }
+        return misses;
+    }
+};
+
+} // namespace
+
+MeshOptimizer::CacheStats MeshOptimizer::measureCache(const vector<unsigned int> &indices, unsigned int verN,
+                                                      unsigned int cacheSize) {
+    CacheStats stats;
+    const size_t faceN = indices.size() / 3;
+    if (faceN == 0) {
+        return stats;
+    }
+    FifoCache cache(verN, cacheSize);
+    vector<unsigned char> used(verN, 0);
+    size_t misses = 0, usedN = 0;
+    for (size_t f = 0; f < faceN; f++) {
+        misses += cache.face(&indices[3 * f]);
+        for (int k = 0; k < 3; k++) {
+            usedN += used[indices[3 * f + k]] == 0;
+            used[indices[3 * f + k]] = 1;
+        }
+    }
+    stats.acmr = float(double(misses) / double(faceN));
+    stats.atvr = float(double(misses) / double(usedN));
+    return stats;
+}
+
+vector<unsigned int> MeshOptimizer::tipsify(const vector<unsigned int> &indices, unsigned int verN,
+                                            unsigned int cacheSize, vector<unsigned int> &clusterStarts) {
+    PROFILE_SCOPE("MeshOptimizer::tipsify");
+    const unsigned int faceN = (unsigned int)(indices.size() / 3);
+    VertexFaceAdjacency adjacency;
+    adjacency.build(indices, verN);
+
+    // Corners of faces not emitted yet, per vertex.
+    vector<unsigned int> live(verN);
+    for (unsigned int v = 0; v < verN; v++) {
+        live[v] = adjacency.valence(v);
+    }
+    // Time stamp of the last cache insertion of every vertex; the cache holds the last
+    // cacheSize insertions.
+    vector<unsigned int> cacheTime(verN, 0);
+    unsigned int time = cacheSize + 1;
+    vector<unsigned char> emitted(faceN, 0);
+    vector<unsigned int> deadEnds;
+    vector<unsigned int> candidates;
+    unsigned int cursor = 0;
+
+    vector<unsigned int> order;
+    order.reserve(faceN);
+    clusterStarts.clear();
+
+    // Vertices with faces left, most recent dead ends first, then in index order.
+    auto skipDeadEnd = [&]() -> int {
+        while (!deadEnds.empty()) {
+            const unsigned int v = deadEnds.back();
+            deadEnds.pop_back();
+            if (live[v] > 0) {
+                return int(v);
+            }
+        }
+        while (cursor < verN) {
+            if (live[cursor] > 0) {
+                return int(cursor);
+            }
+            cursor++;
+        }
+        return -1;
+    };
+
+    int fan = faceN > 0 ? skipDeadEnd() : -1;
+    bool jumped = true;
+    while (fan >= 0) {
+        if (jumped) {
+            clusterStarts.push_back((unsigned int)order.size());
+        }
+        candidates.clear();
+        for (const unsigned int *c = adjacency.begin(fan); c != adjacency.end(fan); c++) {
+            const unsigned int face = *c / 3;
+            if (emitted[face]) {
+                continue;
+            }
+            emitted[face] = 1;
+            order.push_back(face);
+            for (int k = 0; k < 3; k++) {
+                const unsigned int v = indices[3 * face + k];
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = time++;
+                }
+            }
+        }
+
+        // The candidate that stays in the cache while all of its faces are emitted and was
+        // inserted longest ago; a vertex that would fall out of the cache only if nothing else is.
+        int next = -1, best = -1;
+        for (unsigned int v : candidates) {
+            if (live[v] == 0) {
+                continue;
+            }
+            int priority = 0;
+            if (time - cacheTime[v] + 2 * live[v] <= cacheSize) {
+                priority = int(time - cacheTime[v]);
+            }
+            if (priority > best) {
+                best = priority;
+                next = int(v);
+            }
+        }
+        jumped = next < 0;
+        fan = jumped ? skipDeadEnd() : next;
+    }
+    return order;
+}
+
+vector<unsigned int> MeshOptimizer::optimizeOverdraw(const vector<glm::vec3> &positions,
+                                                     const vector<unsigned int> &indices,
+                                                     const vector<unsigned int> &order,
+                                                     const vector<unsigned int> &clusterStarts,
+                                                     unsigned int cacheSize, float threshold) {
+    PROFILE_SCOPE("MeshOptimizer::optimizeOverdraw");
+    const unsigned int faceN = (unsigned int)order.size();
+    if (faceN == 0) {
+        return order;
+    }
+    const unsigned int verN = (unsigned int)positions.size();
+    auto faceIndices = [&](unsigned int position) {
+        return &indices[3 * size_t(order[position])];
+    };
+
+    // Cuts every Tipsify run where the ACMR so far comes within threshold of that of the run.
+    FifoCache cache(verN, cacheSize);
+    vector<unsigned int> starts;
+    for (size_t r = 0; r < clusterStarts.size(); r++) {
+        const unsigned int begin = clusterStarts[r];
+        const unsigned int end = r + 1 < clusterStarts.size() ? clusterStarts[r + 1] : faceN;
+        cache.reset();
+        unsigned int runMisses = 0;
+        for (unsigned int i = begin; i < end; i++) {
+            runMisses += cache.face(faceIndices(i));
+        }
+        const float limit = threshold * float(runMisses) / float(end - begin);
+
+        starts.push_back(begin);
+        cache.reset();
+        unsigned int misses = 0, faces = 0;
+        for (unsigned int i = begin; i + 1 < end; i++) {
+            misses += cache.face(faceIndices(i));
+            faces++;
+            if (float(misses) <= limit * float(faces)) {
+                starts.push_back(i + 1);
+                cache.reset();
+                misses = 0;
+                faces = 0;
+            }
+        }
+    }
+
+    // Area weighted centroid and normal of every cluster and of the mesh.
+    const size_t clusterN = starts.size();
+    vector<glm::dvec3> centroids(clusterN), normals(clusterN);
+    vector<double> areas(clusterN);
+    glm::dvec3 meshCentroid(0.0);
+    double meshArea = 0.0;
+    for (size_t c = 0; c < clusterN; c++) {
+        const unsigned int end = c + 1 < clusterN ? starts[c + 1] : faceN;
+        glm::dvec3 centroid(0.0), normal(0.0);
+        double area = 0.0;
+        for (unsigned int i = starts[c]; i < end; i++) {
+            const unsigned int *index = faceIndices(i);
+            const glm::dvec3 p0(positions[index[0]]), p1(positions[index[1]]), p2(positions[index[2]]);
+            const glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+            const double a = glm::length(n);
+            centroid += (p0 + p1 + p2) * (a / 3.0);
+            normal += n;
+            area += a;
+        }
+        meshCentroid += centroid;
+        meshArea += area;
+        centroids[c] = area > 0.0 ? centroid / area : glm::dvec3(0.0);
+        normals[c] = normal;
+        areas[c] = area;
+    }
+    meshCentroid = meshArea > 0.0 ? meshCentroid / meshArea : glm::dvec3(0.0);
+
+    // Clusters far out along their own normal first.
+    vector<double> keys(clusterN);
+    vector<unsigned int> clusterOrder(clusterN);
+    for (size_t c = 0; c < clusterN; c++) {
+        const double length = glm::length(normals[c]);
+        keys[c] = length > 0.0 ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.0;
+        clusterOrder[c] = (unsigned int)c;
+    }
+    stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](unsigned int a, unsigned int b) {
+        return keys[a] > keys[b];
+    });
+
+    vector<unsigned int> result;
+    result.reserve(faceN);
+    for (unsigned int c : clusterOrder) {
+        const unsigned int end = c + 1 < clusterN ? starts[c + 1] : faceN;
+        result.insert(result.end(), order.begin() + starts[c], order.begin() + end);
+    }
+    return result;
+}
+
+vector<unsigned int> MeshOptimizer::vertexFetchRemap(const vector<unsigned int> &indices, unsigned int verN) {
+    vector<unsigned int> remap(verN, UINT_MAX);
+    unsigned int next = 0;
+    for (unsigned int v : indices) {
+        if (remap[v] == UINT_MAX) {
+            remap[v] = next++;
+        }
+    }
+    for (unsigned int v = 0; v < verN; v++) {
+        if (remap[v] == UINT_MAX) {
+            remap[v] = next++;
+        }
+    }
+    return remap;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include "core/common.h"
+
+// Reorders triangles and vertices for drawing with glDrawElements (see
+// TriMesh::optimizeRenderOrder()):
+//   1. Tipsify (Sander, Nehab and Barczak 2007) orders the faces for the post-transform vertex
+//      cache, fanning around one vertex at a time.
+//   2. Optionally, the Tipsify output is cut into clusters whose cache efficiency stays within
+//      overdrawThreshold of the whole, and the clusters are sorted so that the ones facing away
+//      from the mesh center, which tend to occlude the others, are drawn first. This order is
+//      the same for every view.
+//   3. Optionally, vertices are renumbered in order of first use, so that vertex fetches walk
+//      the vertex buffers forward.
+//
+// Face orders map new to old faces: order[new] = old.
+namespace MeshOptimizer {
+    struct Options {
+        // Entries of the FIFO post-transform cache the order is made for and measured with.
+        unsigned int cacheSize = 16;
+        // Off by default: it costs about as much again as Tipsify and gives up some of its
+        // cache efficiency, which only pays off where fragment shading dominates.
+        bool overdraw = false;
+        // Factor by which a cluster's ACMR may be worse than that of its Tipsify run.
+        float overdrawThreshold = 1.05f;
+        bool vertexFetch = true;
+    };
+
+    // Average cache miss ratio (transformed vertices per triangle, 0.5 at best for large
+    // meshes and 3 at worst) and average transformed to vertex ratio (1 at best).
+    struct CacheStats {
+        float acmr = 0.0f;
+        float atvr = 0.0f;
+    };
+
+    struct Stats {
+        CacheStats before, after;
+    };
+
+    // Simulates a FIFO cache of cacheSize entries over indices (three per face).
+    CacheStats measureCache(const vector<unsigned int> &indices, unsigned int verN, unsigned int cacheSize);
+
+    // Tipsify face order. clusterStarts receives the new face indices where it had to
+    // continue at an unrelated vertex, starting with 0.
+    vector<unsigned int> tipsify(const vector<unsigned int> &indices, unsigned int verN, unsigned int cacheSize,
+                                 vector<unsigned int> &clusterStarts);
+
+    // Sorts the clusters of a Tipsify order (see above); returns the new face order.
+    vector<unsigned int> optimizeOverdraw(const vector<glm::vec3> &positions, const vector<unsigned int> &indices,
+                                          const vector<unsigned int> &order, const vector<unsigned int> &clusterStarts,
+                                          unsigned int cacheSize, float threshold);
+
+    // remap[old] = new vertex index, in order of first use by indices; unused vertices
+    // follow in their old order.
+    vector<unsigned int> vertexFetchRemap(const vector<unsigned int> &indices, unsigned int verN);
+} // namespace MeshOptimizer
+
+#endif //MESH_OPTIMIZER_H
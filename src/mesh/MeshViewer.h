@@ -4,6 +4,7 @@
 #define MESH_VIEWER
 
 #include "opengl-wrapper/FrameBufferObject.h"
+#include "opengl-wrapper/GpuProfiler.h"
 #include "opengl-wrapper/Shader.h"
 #include "TriMesh.h"
 #include "TriMeshLoader.h"
@@ -46,6 +47,7 @@ private:
 	Texture2D crossSection;
 
 	XYZ_Axis xyzAxis;
+	GpuProfiler profiler;
 	float lightPower = 0.0f;
 	inline static char dir[128] = {};
 
@@ -86,7 +88,7 @@ public:
 		texture_shader.create(texture_vert_file, texture_frag_file);
 		crossSection2D_shader.create(crossSection2D_vert_file, crossSection2D_frag_file);
 		crossSection3D_shader.create(crossSection3D_vert_file, crossSection3D_frag_file);
-		mesh->computeAABB();
+		mesh->updateAABB();
 		window->gravity = mesh->centerAABB;
 		cout << window->gravity[0] << " " << window->gravity[1] << " " << window->gravity[2] << endl;
 		cameraPos = glm::vec3((mesh->maxPointAABB.x - mesh->minPointAABB.x) * 2.0f, 0.0f, 0.0f);
@@ -110,11 +112,16 @@ public:
 	}
 
 	void draw() {
+		profiler.beginFrame();
+		profiler.begin("axis");
 		xyzAxis.draw();
+		profiler.end();
 		if (renderingMode == RENDER_SINOGRAM) {
+			GpuProfilerScope scope(profiler, "sinogram");
 			renderSinogram();
 		}
 		else {
+			GpuProfilerScope scope(profiler, "solid");
 			renderSolid();
 		}
 
@@ -135,7 +142,7 @@ public:
 		shader->set_uniform_value(aabbMaxSize, "u_aabbMaxSize");
 		shader->set_uniform_value(lightPower, "u_lightPower");
 		shader->set_uniform_value(glm::vec3(1.0, 1.0, 0.0), "u_materialColor");
-		vao.draw(shadingMethod);
+		vao.draw(shadingMethod, *shader);
 		shader->release();
 	}
 
@@ -164,7 +171,7 @@ public:
 			glEnable(GL_BLEND);
 			glBlendFunc(GL_ONE, GL_ONE);
 
-			vao.draw(FLAT_SHADING);
+			vao.draw(FLAT_SHADING, sinogram_shader);
 
 			glEnable(GL_DEPTH_TEST);
 			glDisable(GL_BLEND);
@@ -174,6 +181,7 @@ public:
 		sinogram_shader.release();
 
 		// ウィンドウへの描画
+		GpuProfilerScope scope(profiler, "sinogram blit");
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		texture_shader.bind();
 
@@ -237,6 +245,7 @@ public:
 			fragColor = glm::vec3(0.0, 0.0, 1.0);
 		}
 
+		GpuProfilerScope scope(profiler, "cross section");
 		{
 			Texture2D depthBuffer(window->width, window->height, GL_DEPTH_COMPONENT32, GL_DEPTH_COMPONENT);
 			fbo.setViewport(window->width, window->height);
@@ -253,7 +262,7 @@ public:
 			glm::mat4 viewMat = glm::lookAt(cameraPos, cameraTarget, upVector);
 			glm::mat4 projMat = glm::ortho(-size / 2.0f, size / 2.0f, -size / 2.0f, size / 2.0f, 0.1f, 1000.0f);
 			crossSection2D_shader.set_uniform_value(projMat * viewMat * window->modelMat, "u_mvpMat");
-			vao.draw(shadingMethod);
+			vao.draw(shadingMethod, crossSection2D_shader);
 			crossSection2D_shader.release();
 			glEnable(GL_DEPTH_TEST);
 			glDisable(GL_COLOR_LOGIC_OP);
@@ -354,6 +363,16 @@ public:
 			capture(dir, name);
 		}
 		ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+		if (ImGui::CollapsingHeader("GPU passes")) {
+			ImGui::Checkbox("measure", &profiler.enabled);
+			for (const GpuProfiler::PassStats& pass : profiler.passes) {
+				ImGui::Text("%-14s mean %.3f ms, p95 %.3f ms", pass.name.c_str(), pass.meanMs(), pass.percentileMs(0.95));
+			}
+			if (ImGui::Button("save GPU trace")) {
+				string path = string(dir[0] == '\0' ? "." : dir) + "/" + name + "_gpu_trace.json";
+				profiler.writeChromeTrace(path);
+			}
+		}
 		ImGui::End();
 
 		if (show_cross_sections) {
@@ -381,7 +400,9 @@ public:
 		int display_w, display_h;
 		glfwGetFramebufferSize(window->window, &display_w, &display_h);
 		glViewport(0, 0, display_w, display_h);
+		profiler.begin("imgui");
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		profiler.end();
 	}
 };
 
@@ -4,24 +4,29 @@
 #define TRI_MESH
 
 #include "core/common.h"
+#include "core/Profiler.h"
+#include "GeometryKernels.h"
+#include "MeshOptimizer.h"
+#include "VertexFaceAdjacency.h"
+#include "VertexWelder.h"
 #include "tinyply.h"
 
-namespace std {
-	template <>
-	struct hash<glm::vec3> {
-		size_t operator()(const glm::vec3& v) const {
-			size_t seed = 0;
-			auto x_hash = hash<float>()(v.x);
-			auto y_hash = hash<float>()(v.y);
-			auto z_hash = hash<float>()(v.z);
-
-			seed ^= x_hash + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-			seed ^= y_hash + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-			seed ^= z_hash + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-			return seed;
-		}
-	};
-} // namespace std
+enum VertexNormalWeighting {
+    AREA_WEIGHTED,
+    ANGLE_WEIGHTED,
+};
+
+// Data TriMesh derives from vertices and verIndices, as a bit mask.
+enum TriMeshDerived : unsigned int {
+    DERIVED_FACE_NORMALS = 1u << 0,
+    DERIVED_FACE_CENTERS = 1u << 1,
+    DERIVED_VER_NORMALS = 1u << 2,
+    DERIVED_VERTEX_FACES = 1u << 3,
+    DERIVED_AABB = 1u << 4,
+    DERIVED_POSITIONS_SOA = 1u << 5,
+    DERIVED_FACE_AREAS = 1u << 6,
+    DERIVED_ALL = (1u << 7) - 1,
+};
 
 class TriMesh {
 public:
@@ -31,16 +36,42 @@ public:
     unsigned int uvfaceN = 0;
     vector<glm::vec3> vertices;
     vector<unsigned int> verIndices;
+    // Derived data (with vertexFaces and the AABB below): built on first use by getFaceNormals()
+    // etc. and rebuilt after markModified(). Each keeps the generation it was built for.
     vector<glm::vec3> verNormals;
     vector<glm::vec3> faceNormals;
     vector<glm::vec3> faceCenters;
+    vector<float> faceAreas;
+    // vertices split into x, y and z arrays for the GeometryKernels.
+    PositionsSoA positionsSoA;
+    // Indexed by uvIndices, or per vertex (by verIndices) when uvIndices is empty, as for PLY.
     vector<glm::vec2> uvs;
+    // Three per face, like verIndices; UINT_MAX for corners without one.
     vector<unsigned int> uvIndices;
+    // Normals stored in the file ("vn" of OBJ, nx/ny/nz of PLY) and their indices, three per
+    // face or none for per-vertex normals; not related to the computed verNormals.
+    vector<glm::vec3> normals;
+    vector<unsigned int> normalIndices;
+    // Corners around every vertex.
+    VertexFaceAdjacency vertexFaces;
     glm::vec3 gravity = {0.0f, 0.0f, 0.0f};
 
     glm::vec3 minPointAABB = {FLT_MAX, FLT_MAX, FLT_MAX};
-    glm::vec3 maxPointAABB = {FLT_MIN, FLT_MIN, FLT_MIN};
-    glm::vec3 centerAABB;
+    glm::vec3 maxPointAABB = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    glm::vec3 centerAABB = {0.0f, 0.0f, 0.0f};
+
+    // Bumped by markModified(); derived data of an older generation is stale.
+    uint64_t generation = 1;
+    uint64_t faceNormalsGeneration = 0;
+    uint64_t faceCentersGeneration = 0;
+    uint64_t verNormalsGeneration = 0;
+    uint64_t vertexFacesGeneration = 0;
+    uint64_t aabbGeneration = 0;
+    uint64_t positionsSoAGeneration = 0;
+    uint64_t faceAreasGeneration = 0;
+    VertexNormalWeighting verNormalsWeighting = AREA_WEIGHTED;
+    // Generation for which optimizeRenderOrder() last ran.
+    uint64_t renderOrderGeneration = 0;
 
 	string filename;
 
@@ -51,6 +82,7 @@ public:
     void addVertex(glm::vec3 vertex) {
         vertices.push_back(vertex);
         verN++;
+        markModified();
     }
 
     void addFace(unsigned int index[3]) {
@@ -58,6 +90,7 @@ public:
         verIndices.push_back(index[1]);
         verIndices.push_back(index[2]);
         faceN++;
+        markModified();
     }
 
 	void addTriangle(glm::vec3 vertexes[3], unsigned int index[3]) {
@@ -79,84 +112,331 @@ public:
         uvfaceN++;
     }
 
+    // Has to be called after changing vertices or verIndices directly; the add* and weld
+    // functions call it themselves. Stale derived data is rebuilt on its next use; its memory
+    // is kept until then or until releaseDerived().
+    void markModified() {
+        generation++;
+    }
+
+    uint64_t &derivedGeneration(TriMeshDerived which) {
+        switch (which) {
+            case DERIVED_FACE_NORMALS: return faceNormalsGeneration;
+            case DERIVED_FACE_CENTERS: return faceCentersGeneration;
+            case DERIVED_VER_NORMALS: return verNormalsGeneration;
+            case DERIVED_VERTEX_FACES: return vertexFacesGeneration;
+            case DERIVED_POSITIONS_SOA: return positionsSoAGeneration;
+            case DERIVED_FACE_AREAS: return faceAreasGeneration;
+            default: return aabbGeneration;
+        }
+    }
+
+    uint64_t derivedGeneration(TriMeshDerived which) const {
+        return const_cast<TriMesh *>(this)->derivedGeneration(which);
+    }
+
+    bool isFresh(TriMeshDerived which) const {
+        return derivedGeneration(which) == generation;
+    }
+
+    // Mask of the derived data that is up to date.
+    unsigned int freshDerived() const {
+        unsigned int fresh = 0;
+        for (unsigned int bit = 1; bit < DERIVED_ALL; bit <<= 1) {
+            fresh |= isFresh(TriMeshDerived(bit)) ? bit : 0;
+        }
+        return fresh;
+    }
+
+    // Marks derived data as up to date, e.g. after reading it from a file.
+    void setFresh(unsigned int which) {
+        for (unsigned int bit = 1; bit < DERIVED_ALL; bit <<= 1) {
+            if (which & bit) {
+                derivedGeneration(TriMeshDerived(bit)) = generation;
+            }
+        }
+    }
+
+    // Builds the derived data of the mask that is missing or stale.
+    void updateDerived(unsigned int which) {
+        if (which & DERIVED_FACE_NORMALS) getFaceNormals();
+        if (which & DERIVED_FACE_CENTERS) getFaceCenters();
+        if (which & DERIVED_VER_NORMALS) getVerNormals();
+        if (which & DERIVED_VERTEX_FACES) getVertexFaces();
+        if (which & DERIVED_AABB) updateAABB();
+        if (which & DERIVED_POSITIONS_SOA) getPositionsSoA();
+        if (which & DERIVED_FACE_AREAS) getFaceAreas();
+    }
+
+    // Frees the derived arrays of the mask (the AABB is only marked stale); they are rebuilt
+    // on their next use. For meshes kept around without needing them, e.g. under memory pressure.
+    void releaseDerived(unsigned int which = DERIVED_ALL) {
+        if (which & DERIVED_FACE_NORMALS) vector<glm::vec3>().swap(faceNormals);
+        if (which & DERIVED_FACE_CENTERS) vector<glm::vec3>().swap(faceCenters);
+        if (which & DERIVED_VER_NORMALS) vector<glm::vec3>().swap(verNormals);
+        if (which & DERIVED_VERTEX_FACES) vertexFaces = VertexFaceAdjacency();
+        if (which & DERIVED_POSITIONS_SOA) positionsSoA = PositionsSoA();
+        if (which & DERIVED_FACE_AREAS) vector<float>().swap(faceAreas);
+        for (unsigned int bit = 1; bit < DERIVED_ALL; bit <<= 1) {
+            if (which & bit) {
+                derivedGeneration(TriMeshDerived(bit)) = 0;
+            }
+        }
+    }
+
+    // Bytes held by the derived arrays, fresh or not.
+    size_t derivedBytes() const {
+        return sizeof(glm::vec3) * (faceNormals.capacity() + faceCenters.capacity() + verNormals.capacity()) +
+               sizeof(unsigned int) * (vertexFaces.offsets.capacity() + vertexFaces.corners.capacity()) +
+               sizeof(float) * (positionsSoA.x.capacity() + positionsSoA.y.capacity() + positionsSoA.z.capacity() +
+                                faceAreas.capacity());
+    }
+
+    const vector<glm::vec3> &getFaceNormals() {
+        if (!isFresh(DERIVED_FACE_NORMALS)) {
+            computeFaceNormals();
+        }
+        return faceNormals;
+    }
+
+    const vector<glm::vec3> &getFaceCenters() {
+        if (!isFresh(DERIVED_FACE_CENTERS)) {
+            computeFaceCenters();
+        }
+        return faceCenters;
+    }
+
+    const vector<glm::vec3> &getVerNormals(VertexNormalWeighting weighting = AREA_WEIGHTED) {
+        if (!isFresh(DERIVED_VER_NORMALS) || verNormalsWeighting != weighting) {
+            computeVerNormals(weighting);
+        }
+        return verNormals;
+    }
+
+    const vector<float> &getFaceAreas() {
+        if (!isFresh(DERIVED_FACE_AREAS)) {
+            computeFaceAreas();
+        }
+        return faceAreas;
+    }
+
+    const PositionsSoA &getPositionsSoA() {
+        if (!isFresh(DERIVED_POSITIONS_SOA)) {
+            positionsSoA.build(vertices);
+            positionsSoAGeneration = generation;
+        }
+        return positionsSoA;
+    }
+
+    const VertexFaceAdjacency &getVertexFaces() {
+        if (!isFresh(DERIVED_VERTEX_FACES)) {
+            computeVertexFaceAdjacency();
+        }
+        return vertexFaces;
+    }
+
+    // Makes minPointAABB, maxPointAABB and centerAABB up to date.
+    void updateAABB() {
+        if (!isFresh(DERIVED_AABB)) {
+            computeAABB();
+        }
+    }
+
+    // The compute functions always rebuild; the get functions above only if needed.
     void computeFaceNormals() {
-        faceNormals.clear();
+        PROFILE_SCOPE("TriMesh::computeFaceNormals");
         faceNormals.resize(faceN);
-#pragma omp parallel for
-        for (int i = 0; i < (int)faceN; i++) {
-            unsigned int index[3] = {verIndices[3 * i + 0], verIndices[3 * i + 1], verIndices[3 * i + 2]};
-            glm::vec3 v1 = vertices[index[1]] - vertices[index[0]];
-            glm::vec3 v2 = vertices[index[2]] - vertices[index[1]];
-            faceNormals[i] = normalize(cross(v1, v2));
-        }
+        GeometryKernels::faceNormals(getPositionsSoA(), verIndices.data(), faceN, faceNormals.data(), nullptr);
+        faceNormalsGeneration = generation;
+    }
+
+    void computeFaceAreas() {
+        PROFILE_SCOPE("TriMesh::computeFaceAreas");
+        faceAreas.resize(faceN);
+        GeometryKernels::faceNormals(getPositionsSoA(), verIndices.data(), faceN, nullptr, faceAreas.data());
+        faceAreasGeneration = generation;
+    }
+
+    // Rebuilds vertexFaces from verIndices.
+    void computeVertexFaceAdjacency() {
+        vertexFaces.build(verIndices, verN);
+        vertexFacesGeneration = generation;
     }
 
-    void computeVerNormals() {
-        verNormals.clear();
-        verNormals.resize(verN, glm::vec3(0.0f));
-        //#pragma omp parallel for
+    // Normalized sum of the normals of the faces around every vertex, weighted by face area or
+    // by the angle of the face at the vertex. Gathers over vertexFaces (built if stale), so
+    // every vertex is written by one thread and the sums keep the face order.
+    void computeVerNormals(VertexNormalWeighting weighting = AREA_WEIGHTED) {
+        PROFILE_SCOPE("TriMesh::computeVerNormals");
+        getVertexFaces();
+        // Twice the area times the normal, or the unit normal and the angle at every corner.
+        vector<glm::vec3> faceCross(faceN);
+        vector<float> cornerAngles(weighting == ANGLE_WEIGHTED ? 3 * size_t(faceN) : 0);
+#pragma omp parallel for
         for (int i = 0; i < (int)faceN; i++) {
             unsigned int index[3] = {verIndices[3 * i + 0], verIndices[3 * i + 1], verIndices[3 * i + 2]};
             glm::vec3 v1 = vertices[index[1]] - vertices[index[0]];
             glm::vec3 v2 = vertices[index[2]] - vertices[index[1]];
-            verNormals[index[0]] += cross(v1, v2);
-            verNormals[index[1]] += cross(v1, v2);
-            verNormals[index[2]] += cross(v1, v2);
+            faceCross[i] = cross(v1, v2);
+            if (weighting == ANGLE_WEIGHTED) {
+                const float length = glm::length(faceCross[i]);
+                faceCross[i] = length > 0.0f ? faceCross[i] / length : glm::vec3(0.0f);
+                for (int k = 0; k < 3; k++) {
+                    const glm::vec3 a = vertices[index[(k + 1) % 3]] - vertices[index[k]];
+                    const glm::vec3 b = vertices[index[(k + 2) % 3]] - vertices[index[k]];
+                    const float cosine = dot(a, b) / sqrt(dot(a, a) * dot(b, b));
+                    cornerAngles[3 * i + k] = length > 0.0f ? acos(glm::clamp(cosine, -1.0f, 1.0f)) : 0.0f;
+                }
+            }
         }
-        //#pragma omp parallel for
-        for (int i = 0; i < (int)verN; i++) {
-            verNormals[i] = normalize(verNormals[i]);
+        verNormals.resize(verN);
+#pragma omp parallel for schedule(dynamic, 1024)
+        for (int v = 0; v < (int)verN; v++) {
+            glm::vec3 sum(0.0f);
+            for (const unsigned int *c = vertexFaces.begin(v); c != vertexFaces.end(v); c++) {
+                sum += weighting == ANGLE_WEIGHTED ? faceCross[*c / 3] * cornerAngles[*c] : faceCross[*c / 3];
+            }
+            verNormals[v] = normalize(sum);
         }
+        verNormalsGeneration = generation;
+        verNormalsWeighting = weighting;
     }
 
     void computeFaceCenters() {
-        faceCenters.clear();
+        PROFILE_SCOPE("TriMesh::computeFaceCenters");
         faceCenters.resize(faceN);
-#pragma omp parallel for
-        for (int i = 0; i < faceN; i++) {
-            unsigned int index[3] = {verIndices[3 * i + 0], verIndices[3 * i + 1], verIndices[3 * i + 2]};
-            faceCenters[i] = (vertices[index[0]] + vertices[index[1]] + vertices[index[2]]) / 3.0f;
-        }
+        GeometryKernels::faceCenters(getPositionsSoA(), verIndices.data(), faceN, faceCenters.data());
+        faceCentersGeneration = generation;
     }
 
     void computeGravity() {
-        for (int i = 0; i < verN; i++) {
-            gravity += vertices[i] / (float)verN;
-        }
+        gravity = glm::vec3(GeometryKernels::centroid(getPositionsSoA()));
     }
 
     void computeAABB() {
-        for (int i = 0; i < verN; i++) {
-            for (int j = 0; j < 3; j++) {
-                minPointAABB[j] = min(vertices[i][j], minPointAABB[j]);
-                maxPointAABB[j] = max(vertices[i][j], maxPointAABB[j]);
-            }
-        }
+        PROFILE_SCOPE("TriMesh::computeAABB");
+        GeometryKernels::bounds(getPositionsSoA(), minPointAABB, maxPointAABB);
         centerAABB = (minPointAABB + maxPointAABB) / 2.0f;
+        aabbGeneration = generation;
     }
 
-	void unifyDuprecatedVertices() {
-		unordered_map<glm::vec3, int> mp;
-		int tmpVerN = 0;
-		for (int i = 0; i < verN; i++) {
-			bool exists = mp.emplace(vertices[i], tmpVerN).second;
-			if (exists)
-				tmpVerN++;
-		}
-		verN = tmpVerN;
+    // Merges vertices in the same cell of a grid with spacing epsilon (bitwise equal positions
+    // for 0) into the first of them; see VertexWelder. With weldAttributes, per-vertex uvs and
+    // normals have to be equal as well, otherwise those of the first vertex are kept.
+    void weldVertices(float epsilon = 0.0f, bool weldAttributes = true) {
+        PROFILE_SCOPE("TriMesh::weldVertices");
+        const bool vertexUvs = verN > 0 && uvIndices.empty() && uvs.size() == verN;
+        const bool vertexNormals = verN > 0 && normalIndices.empty() && normals.size() == verN;
+        vector<VertexWelder::Attribute> attributes;
+        if (weldAttributes && vertexUvs) {
+            attributes.push_back({glm::value_ptr(uvs[0]), 2});
+        }
+        if (weldAttributes && vertexNormals) {
+            attributes.push_back({glm::value_ptr(normals[0]), 3});
+        }
+        vector<unsigned int> remap, representatives;
+        VertexWelder::weld(vertices, remap, representatives, epsilon, attributes);
 #pragma omp parallel for
-		for (int i = 0; i < faceN; i++) {
-			verIndices[3 * i + 0] = mp[vertices[verIndices[3 * i + 0]]];
-			verIndices[3 * i + 1] = mp[vertices[verIndices[3 * i + 1]]];
-			verIndices[3 * i + 2] = mp[vertices[verIndices[3 * i + 2]]];
-		}
-		vertices.clear();
-		vertices.resize(mp.size());
-
-		for (auto& elem : mp) {
-			vertices[elem.second] = elem.first;
-		}
-	}
+        for (int i = 0; i < (int)verIndices.size(); i++) {
+            verIndices[i] = remap[verIndices[i]];
+        }
+        vertices = VertexWelder::gather(vertices, representatives);
+        if (vertexUvs) {
+            uvs = VertexWelder::gather(uvs, representatives);
+            uvN = (unsigned int)uvs.size();
+        }
+        if (vertexNormals) {
+            normals = VertexWelder::gather(normals, representatives);
+        }
+        verN = (unsigned int)vertices.size();
+        // Exact welding keeps every position, so the AABB stays; the rest is sized for the old
+        // vertices.
+        const bool aabbFresh = epsilon == 0.0f && isFresh(DERIVED_AABB);
+        markModified();
+        releaseDerived(DERIVED_ALL & ~DERIVED_AABB);
+        if (aabbFresh) {
+            setFresh(DERIVED_AABB);
+        }
+    }
+
+    bool isRenderOrderOptimized() const {
+        return renderOrderGeneration == generation;
+    }
+
+    // Reorders faces and vertices for drawing; see MeshOptimizer. Per-face and per-vertex
+    // arrays (uvs, normals and their indices) move along, as do fresh face normals, centers
+    // and areas and vertex normals; the result draws the same triangles.
+    MeshOptimizer::Stats optimizeRenderOrder(const MeshOptimizer::Options &options = {}) {
+        PROFILE_SCOPE("TriMesh::optimizeRenderOrder");
+        MeshOptimizer::Stats stats;
+        stats.before = MeshOptimizer::measureCache(verIndices, verN, options.cacheSize);
+        vector<unsigned int> clusterStarts;
+        vector<unsigned int> order = MeshOptimizer::tipsify(verIndices, verN, options.cacheSize, clusterStarts);
+        if (options.overdraw) {
+            order = MeshOptimizer::optimizeOverdraw(vertices, verIndices, order, clusterStarts, options.cacheSize,
+                                                    options.overdrawThreshold);
+        }
+
+        // order[new] = old face.
+        auto permuteFaces = [&](auto &values, size_t perFace) {
+            if (values.size() != perFace * faceN) {
+                return;
+            }
+            auto permuted = values;
+#pragma omp parallel for
+            for (int f = 0; f < (int)faceN; f++) {
+                for (size_t k = 0; k < perFace; k++) {
+                    permuted[perFace * f + k] = values[perFace * order[f] + k];
+                }
+            }
+            values.swap(permuted);
+        };
+        const unsigned int carried = freshDerived() & (DERIVED_FACE_NORMALS | DERIVED_FACE_CENTERS |
+                                                       DERIVED_FACE_AREAS | DERIVED_VER_NORMALS | DERIVED_AABB);
+        permuteFaces(verIndices, 3);
+        permuteFaces(uvIndices, 3);
+        permuteFaces(normalIndices, 3);
+        if (carried & DERIVED_FACE_NORMALS) permuteFaces(faceNormals, 1);
+        if (carried & DERIVED_FACE_CENTERS) permuteFaces(faceCenters, 1);
+        if (carried & DERIVED_FACE_AREAS) permuteFaces(faceAreas, 1);
+
+        if (options.vertexFetch) {
+            const vector<unsigned int> remap = MeshOptimizer::vertexFetchRemap(verIndices, verN);
+            // remap[old] = new vertex.
+            auto permuteVertices = [&](auto &values) {
+                if (values.size() != verN) {
+                    return;
+                }
+                auto permuted = values;
+#pragma omp parallel for
+                for (int v = 0; v < (int)verN; v++) {
+                    permuted[remap[v]] = values[v];
+                }
+                values.swap(permuted);
+            };
+#pragma omp parallel for
+            for (int i = 0; i < (int)verIndices.size(); i++) {
+                verIndices[i] = remap[verIndices[i]];
+            }
+            permuteVertices(vertices);
+            if (uvIndices.empty()) {
+                permuteVertices(uvs);
+            }
+            if (normalIndices.empty()) {
+                permuteVertices(normals);
+            }
+            if (carried & DERIVED_VER_NORMALS) {
+                permuteVertices(verNormals);
+            }
+        }
+
+        markModified();
+        releaseDerived(DERIVED_ALL & ~carried);
+        setFresh(carried);
+        renderOrderGeneration = generation;
+        stats.after = MeshOptimizer::measureCache(verIndices, verN, options.cacheSize);
+        return stats;
+    }
 
 	void writePly(const std::string& filename)
 	{
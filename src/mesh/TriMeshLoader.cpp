@@ -1,175 +1,911 @@
 #include"TriMeshLoader.h"
+#include "core/MappedFile.h"
+#include "VertexWelder.h"
 
-TriMesh TriMeshLoader::loadOBJ(string& filepath) {
-	TriMesh mesh;
+namespace {
+	// Files are split into chunks of about this size, one OpenMP iteration each.
+	const size_t OBJ_CHUNK_SIZE = size_t(1) << 20;
+	const unsigned int OBJ_NO_INDEX = UINT_MAX;
 
-	FILE* file = fopen(filepath.c_str(), "r");
-	if (file == NULL) {
-		printf("File does not exist.");
-		exit(1);
+	inline bool isBlank(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
 	}
-	int cnt = 0;
-	while (1) {
-		cnt++;
-		char lineHeader[128];
-		// read the first word of the line
-		int res = fscanf(file, "%s", lineHeader);
-		if (res == EOF)
-			break; // EOF = End Of File. Quit the loop.
-
-		// else : parse lineHeader
-
-		if (strcmp(lineHeader, "v") == 0) {
-			glm::vec3 vertex;
-			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-			mesh.addVertex(vertex);
-		}
-		else if (strcmp(lineHeader, "vt") == 0) {
-			glm::vec2 uv;
-			fscanf(file, "%f %f\n", &uv.x, &uv.y);
-			uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
-			mesh.adduv(uv);
-		}
-		else if (strcmp(lineHeader, "vn") == 0) {
-			continue;
-			glm::vec3 normal;
-			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-			mesh.verNormals.push_back(normal);
-		}
-		else if (strcmp(lineHeader, "f") == 0) {
-			std::string vertex1, vertex2, vertex3;
-			unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-			char buffer[128];
-			fgets(buffer, 128, file);
-			if (sscanf(buffer, "%d %d %d\n"
-				, &vertexIndex[0]
-				, &vertexIndex[1]
-				, &vertexIndex[2]) == 3) {
-				cout << "hoge" << endl;
-				for (int j = 0; j < 3; j++)vertexIndex[j]--;
-				mesh.addFace(vertexIndex);
-				continue;
-			}
-			else if (sscanf(buffer, "%d//%d %d//%d %d//%d\n"
-				, &vertexIndex[0], &normalIndex[0]
-				, &vertexIndex[1], &normalIndex[1]
-				, &vertexIndex[2], &normalIndex[2]) == 6) {
-				for (int j = 0; j < 3; j++)vertexIndex[j]--;
-				mesh.addFace(vertexIndex);
-				continue;
-			}
-			else if (sscanf(buffer, "%d/%d/%d %d/%d/%d %d/%d/%d\n"
-				, &vertexIndex[0], &uvIndex[0], &normalIndex[0]
-				, &vertexIndex[1], &uvIndex[1], &normalIndex[1]
-				, &vertexIndex[2], &uvIndex[2], &normalIndex[2]) == 9) {
-				for (int j = 0; j < 3; j++)vertexIndex[j]--;
-				mesh.addFace(vertexIndex);
-				continue;
+
+	inline const char* skipBlanks(const char* p, const char* end) {
+		while (p < end && isBlank(*p)) p++;
+		return p;
+	}
+
+	inline const char* nextLine(const char* p, const char* end) {
+		const void* newline = memchr(p, '\n', size_t(end - p));
+		return newline ? static_cast<const char*>(newline) + 1 : end;
+	}
+
+	// Decimal float such as "-1.25e-3". Anything else (inf, nan, hex) goes through strtof.
+	const char* parseFloat(const char* p, const char* end, float& value) {
+		static const double POWERS[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+		const char* start = p;
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			p++;
+		}
+		uint64_t mantissa = 0;
+		int digits = 0, exponent = 0;
+		bool any = false;
+		for (; p < end && unsigned(*p - '0') < 10u; p++, any = true) {
+			if (digits < 19) {
+				mantissa = mantissa * 10 + unsigned(*p - '0');
+				digits += mantissa != 0;
 			}
 			else {
-				fprintf(stderr, "File can't be read by our simple parser\n");
-				exit(1);
+				exponent++;
 			}
 		}
-		else {
-			// Probably a comment, eat up the rest of the line
-			char stupidBuffer[1000];
-			fgets(stupidBuffer, 1000, file);
+		if (p < end && *p == '.') {
+			for (p++; p < end && unsigned(*p - '0') < 10u; p++, any = true) {
+				if (digits < 19) {
+					mantissa = mantissa * 10 + unsigned(*p - '0');
+					digits += mantissa != 0;
+					exponent--;
+				}
+			}
+		}
+		if (any && p < end && (*p == 'e' || *p == 'E')) {
+			const char* q = p + 1;
+			bool negativeExponent = false;
+			if (q < end && (*q == '-' || *q == '+')) {
+				negativeExponent = *q == '-';
+				q++;
+			}
+			if (q < end && unsigned(*q - '0') < 10u) {
+				int e = 0;
+				for (; q < end && unsigned(*q - '0') < 10u; q++) {
+					e = min(e * 10 + (*q - '0'), 1000);
+				}
+				exponent += negativeExponent ? -e : e;
+				p = q;
+			}
+		}
+		if (!any) {
+			char token[64];
+			size_t n = 0;
+			for (p = start; p < end && !isBlank(*p) && *p != '\n' && n < sizeof(token) - 1; p++) {
+				token[n++] = *p;
+			}
+			token[n] = '\0';
+			char* parsed = token;
+			value = strtof(token, &parsed);
+			return parsed == token ? nullptr : start + (parsed - token);
+		}
+		double v = double(mantissa);
+		if (exponent < 0) {
+			v = -exponent <= 22 ? v / POWERS[-exponent] : v * pow(10.0, exponent);
+		}
+		else if (exponent > 0) {
+			v = exponent <= 22 ? v * POWERS[exponent] : v * pow(10.0, exponent);
+		}
+		value = float(negative ? -v : v);
+		return p;
+	}
+
+	inline const char* parseInt(const char* p, const char* end, long long& value) {
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			p++;
+		}
+		if (p == end || unsigned(*p - '0') >= 10u) {
+			return nullptr;
+		}
+		long long v = 0;
+		for (; p < end && unsigned(*p - '0') < 10u; p++) {
+			v = v * 10 + (*p - '0');
+		}
+		value = negative ? -v : v;
+		return p;
+	}
+
+	// 1-based index, or negative relative to the `defined` elements read so far.
+	inline bool resolveIndex(long long index, size_t defined, unsigned int& resolved) {
+		const long long i = index > 0 ? index - 1 : (long long)defined + index;
+		if (index == 0 || i < 0 || i >= (long long)defined) {
+			return false;
+		}
+		resolved = (unsigned int)i;
+		return true;
+	}
+
+	enum ObjLineType {
+		OBJ_OTHER, OBJ_VERTEX, OBJ_UV, OBJ_NORMAL, OBJ_FACE,
+	};
+
+	// Classifies a line and returns the position after its keyword.
+	inline ObjLineType lineType(const char*& p, const char* end) {
+		p = skipBlanks(p, end);
+		if (end - p < 2) {
+			return OBJ_OTHER;
+		}
+		if (p[0] == 'v') {
+			if (isBlank(p[1])) {
+				p += 2;
+				return OBJ_VERTEX;
+			}
+			if (end - p >= 3 && isBlank(p[2])) {
+				if (p[1] == 't') {
+					p += 3;
+					return OBJ_UV;
+				}
+				if (p[1] == 'n') {
+					p += 3;
+					return OBJ_NORMAL;
+				}
+			}
+		}
+		else if (p[0] == 'f' && isBlank(p[1])) {
+			p += 2;
+			return OBJ_FACE;
+		}
+		return OBJ_OTHER;
+	}
+
+	struct ObjChunk {
+		const char* begin;
+		const char* end;
+		// Counts of this chunk, then turned into the counts of all chunks before it.
+		size_t lines = 0, vertices = 0, uvs = 0, normals = 0;
+		// Triangles of the chunk, three corners each; OBJ_NO_INDEX where a corner has no uv / normal.
+		vector<unsigned int> verIndices, uvIndices, normalIndices;
+		bool hasUvs = false, hasNormals = false;
+		size_t errorLine = 0;
+		string error;
+	};
+
+	// Parses the lines of chunk. Vertex attributes go straight to their final place in mesh;
+	// faces are collected in the chunk and stitched afterwards.
+	void parseObjChunk(ObjChunk& chunk, TriMesh& mesh) {
+		size_t vertexCount = chunk.vertices, uvCount = chunk.uvs, normalCount = chunk.normals;
+		size_t line = chunk.lines;
+		vector<unsigned int> corners[3];
+		auto fail = [&](const char* message) {
+			chunk.error = message;
+			chunk.errorLine = line + 1;
+		};
+		for (const char* p = chunk.begin; p < chunk.end; line++) {
+			const char* lineEnd = nextLine(p, chunk.end);
+			const ObjLineType type = lineType(p, lineEnd);
+			if (type == OBJ_VERTEX || type == OBJ_NORMAL) {
+				glm::vec3 v;
+				for (int i = 0; i < 3 && p; i++) {
+					p = parseFloat(skipBlanks(p, lineEnd), lineEnd, v[i]);
+				}
+				if (!p) {
+					return fail("malformed vertex");
+				}
+				if (type == OBJ_VERTEX) {
+					mesh.vertices[vertexCount++] = v;
+				}
+				else {
+					mesh.normals[normalCount++] = v;
+				}
+			}
+			else if (type == OBJ_UV) {
+				glm::vec2 uv;
+				for (int i = 0; i < 2 && p; i++) {
+					p = parseFloat(skipBlanks(p, lineEnd), lineEnd, uv[i]);
+				}
+				if (!p) {
+					return fail("malformed texture coordinate");
+				}
+				uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
+				mesh.uvs[uvCount++] = uv;
+			}
+			else if (type == OBJ_FACE) {
+				// Corners "v", "v/vt", "v//vn" or "v/vt/vn"; polygons become triangle fans.
+				for (vector<unsigned int>& c : corners) c.clear();
+				for (p = skipBlanks(p, lineEnd); p < lineEnd && *p != '\n' && *p != '#'; p = skipBlanks(p, lineEnd)) {
+					long long index;
+					unsigned int v, vt = OBJ_NO_INDEX, vn = OBJ_NO_INDEX;
+					p = parseInt(p, lineEnd, index);
+					if (!p || !resolveIndex(index, vertexCount, v)) {
+						return fail("invalid vertex index");
+					}
+					if (p < lineEnd && *p == '/') {
+						p++;
+						if (p < lineEnd && *p != '/') {
+							p = parseInt(p, lineEnd, index);
+							if (!p || !resolveIndex(index, uvCount, vt)) {
+								return fail("invalid texture coordinate index");
+							}
+						}
+						if (p < lineEnd && *p == '/') {
+							p = parseInt(p + 1, lineEnd, index);
+							if (!p || !resolveIndex(index, normalCount, vn)) {
+								return fail("invalid normal index");
+							}
+						}
+					}
+					corners[0].push_back(v);
+					corners[1].push_back(vt);
+					corners[2].push_back(vn);
+				}
+				if (corners[0].size() < 3) {
+					return fail("face with less than three vertices");
+				}
+				for (size_t k = 1; k + 1 < corners[0].size(); k++) {
+					for (size_t corner : { size_t(0), k, k + 1 }) {
+						chunk.verIndices.push_back(corners[0][corner]);
+						chunk.uvIndices.push_back(corners[1][corner]);
+						chunk.normalIndices.push_back(corners[2][corner]);
+						chunk.hasUvs |= corners[1][corner] != OBJ_NO_INDEX;
+						chunk.hasNormals |= corners[2][corner] != OBJ_NO_INDEX;
+					}
+				}
+			}
+			p = lineEnd;
 		}
 	}
-	cout << "total vertices : " << mesh.verN << endl;
-	cout << "total faces : " << mesh.faceN << endl;
-	return mesh;
 }
 
-TriMesh TriMeshLoader::loadPly(string& filepath) {
+TriMesh TriMeshLoader::loadOBJ(string& filepath) {
+	PROFILE_SCOPE("TriMeshLoader::loadOBJ");
 	TriMesh mesh;
+	MappedFile file(filepath);
+	const char* data = file.data();
+	const char* end = data + file.size();
 
-	std::ifstream ss(filepath, std::ios::binary);
-	if (ss.fail()) {
-		fprintf(stderr, "File does not exist.");
+	// Newline-aligned chunks.
+	vector<ObjChunk> chunks;
+	for (const char* p = data; p < end;) {
+		const char* chunkEnd = p + min(OBJ_CHUNK_SIZE, size_t(end - p));
+		chunkEnd = chunkEnd < end ? nextLine(chunkEnd, end) : end;
+		chunks.push_back(ObjChunk{ p, chunkEnd });
+		p = chunkEnd;
 	}
 
-	PlyFile file;
-	file.parse_header(ss);
+	// Pass 1 counts the lines and attributes of every chunk, so that the vertex attributes
+	// can be written in place and negative indices resolved in pass 2.
+	{
+		PROFILE_SCOPE("count");
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int c = 0; c < (int)chunks.size(); c++) {
+			ObjChunk& chunk = chunks[c];
+			for (const char* p = chunk.begin; p < chunk.end; chunk.lines++) {
+				const char* lineEnd = nextLine(p, chunk.end);
+				switch (lineType(p, lineEnd)) {
+				case OBJ_VERTEX: chunk.vertices++; break;
+				case OBJ_UV: chunk.uvs++; break;
+				case OBJ_NORMAL: chunk.normals++; break;
+				default: break;
+				}
+				p = lineEnd;
+			}
+		}
+	}
+	size_t lines = 0, vertices = 0, uvs = 0, normals = 0;
+	for (ObjChunk& chunk : chunks) {
+		swap(lines, chunk.lines);
+		swap(vertices, chunk.vertices);
+		swap(uvs, chunk.uvs);
+		swap(normals, chunk.normals);
+		lines += chunk.lines;
+		vertices += chunk.vertices;
+		uvs += chunk.uvs;
+		normals += chunk.normals;
+	}
+	mesh.vertices.resize(vertices);
+	mesh.uvs.resize(uvs);
+	mesh.normals.resize(normals);
 
-	std::cout << "........................................................................\n";
-	for (auto c : file.get_comments()) std::cout << "Comment: " << c << std::endl;
-	for (auto e : file.get_elements())
 	{
-		std::cout << "element - " << e.name << " (" << e.size << ")" << std::endl;
-		for (auto p : e.properties) std::cout << "\tproperty - " << p.name << " (" << tinyply::PropertyTable[p.propertyType].str << ")" << std::endl;
+		PROFILE_SCOPE("parse");
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int c = 0; c < (int)chunks.size(); c++) {
+			parseObjChunk(chunks[c], mesh);
+		}
 	}
-	std::cout << "........................................................................\n";
+	for (const ObjChunk& chunk : chunks) {
+		if (!chunk.error.empty()) {
+			fprintf(stderr, "%s:%zu: %s\n", filepath.c_str(), chunk.errorLine, chunk.error.c_str());
+			exit(1);
+		}
+	}
+
+	// Stitches the faces of the chunks together.
+	vector<size_t> offsets(chunks.size() + 1, 0);
+	bool hasUvs = false, hasNormals = false;
+	for (size_t c = 0; c < chunks.size(); c++) {
+		offsets[c + 1] = offsets[c] + chunks[c].verIndices.size();
+		hasUvs |= chunks[c].hasUvs;
+		hasNormals |= chunks[c].hasNormals;
+	}
+	mesh.verIndices.resize(offsets.back());
+	mesh.uvIndices.resize(hasUvs ? offsets.back() : 0);
+	mesh.normalIndices.resize(hasNormals ? offsets.back() : 0);
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int c = 0; c < (int)chunks.size(); c++) {
+		ObjChunk& chunk = chunks[c];
+		copy(chunk.verIndices.begin(), chunk.verIndices.end(), mesh.verIndices.begin() + offsets[c]);
+		if (hasUvs) {
+			copy(chunk.uvIndices.begin(), chunk.uvIndices.end(), mesh.uvIndices.begin() + offsets[c]);
+		}
+		if (hasNormals) {
+			copy(chunk.normalIndices.begin(), chunk.normalIndices.end(), mesh.normalIndices.begin() + offsets[c]);
+		}
+		vector<unsigned int>().swap(chunk.verIndices);
+		vector<unsigned int>().swap(chunk.uvIndices);
+		vector<unsigned int>().swap(chunk.normalIndices);
+	}
+	mesh.verN = (unsigned int)mesh.vertices.size();
+	mesh.faceN = (unsigned int)(mesh.verIndices.size() / 3);
+	mesh.uvN = (unsigned int)mesh.uvs.size();
+	mesh.uvfaceN = hasUvs ? mesh.faceN : 0;
+
+	if (verbose) {
+		cout << "total vertices : " << mesh.verN << endl;
+		cout << "total faces : " << mesh.faceN << endl;
+	}
+	return mesh;
+}
+
+namespace {
+	enum PlyType {
+		PLY_INVALID, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64,
+	};
+
+	const char* const PLY_TYPE_NAMES[] = { "invalid", "int8", "uint8", "int16", "uint16", "int32", "uint32", "float32", "float64" };
+	const size_t PLY_TYPE_SIZES[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
 
-	// Tinyply treats parsed data as untyped byte buffers. See below for examples.
-	std::shared_ptr<PlyData> vertices, normals, faces, texcoords;
+	PlyType plyType(const string& name) {
+		static const pair<const char*, PlyType> ALIASES[] = {
+			{ "char", PLY_INT8 }, { "uchar", PLY_UINT8 }, { "short", PLY_INT16 }, { "ushort", PLY_UINT16 },
+			{ "int", PLY_INT32 }, { "uint", PLY_UINT32 }, { "float", PLY_FLOAT32 }, { "double", PLY_FLOAT64 },
+		};
+		for (int type = PLY_INT8; type <= PLY_FLOAT64; type++) {
+			if (name == PLY_TYPE_NAMES[type]) return PlyType(type);
+		}
+		for (const auto& alias : ALIASES) {
+			if (name == alias.first) return alias.second;
+		}
+		return PLY_INVALID;
+	}
 
-	// The header information can be used to programmatically extract properties on elements
-	// known to exist in the header prior to reading the data. For brevity of this sample, properties 
-	// like vertex position are hard-coded: 
-	try { vertices = file.request_properties_from_element("vertex", { "x", "y", "z" }); }
-	catch (const std::exception& e) { std::cerr << "tinyply exception: " << e.what() << std::endl; }
+	// Calls f with a value of the C++ type that stores a PLY type.
+	template<typename F>
+	void dispatchPlyType(PlyType type, F f) {
+		switch (type) {
+		case PLY_INT8: f(int8_t()); break;
+		case PLY_UINT8: f(uint8_t()); break;
+		case PLY_INT16: f(int16_t()); break;
+		case PLY_UINT16: f(uint16_t()); break;
+		case PLY_INT32: f(int32_t()); break;
+		case PLY_UINT32: f(uint32_t()); break;
+		case PLY_FLOAT32: f(float()); break;
+		case PLY_FLOAT64: f(double()); break;
+		default: break;
+		}
+	}
 
-	try { normals = file.request_properties_from_element("vertex", { "nx", "ny", "nz" }); }
-	catch (const std::exception& e) { std::cerr << "tinyply exception: " << e.what() << std::endl; }
+	// Unaligned load of a binary value, byte swapped when the file's endianness differs.
+	template<typename T, bool Swap>
+	inline T loadPlyValue(const char* p) {
+		unsigned char bytes[sizeof(T)];
+		memcpy(bytes, p, sizeof(T));
+		if (Swap) {
+			reverse(bytes, bytes + sizeof(T));
+		}
+		T value;
+		memcpy(&value, bytes, sizeof(T));
+		return value;
+	}
 
-	try { texcoords = file.request_properties_from_element("vertex", { "u", "v" }); }
-	catch (const std::exception& e) { std::cerr << "tinyply exception: " << e.what() << std::endl; }
+	struct PlyHeaderProperty {
+		string name;
+		PlyType type = PLY_INVALID;
+		// Type of the length of list properties, PLY_INVALID for scalars.
+		PlyType countType = PLY_INVALID;
+		// Byte offset in a binary record, valid up to the first list property.
+		size_t offset = 0;
+	};
 
-	// Providing a list size hint (the last argument) is a 2x performance improvement. If you have 
-	// arbitrary ply files, it is best to leave this 0. 
-	try { faces = file.request_properties_from_element("face", { "vertex_indices" }, 3); }
-	catch (const std::exception& e) { std::cerr << "tinyply exception: " << e.what() << std::endl; }
+	struct PlyHeaderElement {
+		string name;
+		size_t count = 0;
+		vector<PlyHeaderProperty> properties;
+		// Binary record size, 0 if the element has list properties.
+		size_t stride = 0;
 
-	file.read(ss);
+		int find(const vector<const char*>& names) const {
+			for (const char* name : names) {
+				for (size_t i = 0; i < properties.size(); i++) {
+					if (properties[i].name == name) return int(i);
+				}
+			}
+			return -1;
+		}
+	};
 
-	if (vertices) std::cout << "\tRead " << vertices->count << " total vertices " << std::endl;
-	if (normals) std::cout << "\tRead " << normals->count << " total vertex normals " << std::endl;
-	if (texcoords) std::cout << "\tRead " << texcoords->count << " total vertex texcoords " << std::endl;
-	if (faces) std::cout << "\tRead " << faces->count << " total faces (triangles) " << std::endl;
+	enum PlyFormat {
+		PLY_ASCII, PLY_BINARY_LITTLE_ENDIAN, PLY_BINARY_BIG_ENDIAN,
+	};
 
-	const size_t numVerticesBytes = vertices->buffer.size_bytes();
-	mesh.vertices.resize(vertices->count);
-	std::memcpy(mesh.vertices.data(), vertices->buffer.get(), numVerticesBytes);
-	mesh.verN = vertices->count;
-	const size_t numFacesBytes = faces->buffer.size_bytes();
-	mesh.verIndices.resize(faces->count * 3);
-	std::memcpy(mesh.verIndices.data(), faces->buffer.get(), numFacesBytes);
-	mesh.faceN = faces->count;
+	struct PlyHeader {
+		PlyFormat format = PLY_ASCII;
+		vector<string> comments;
+		vector<PlyHeaderElement> elements;
+		// Bytes up to and including the end_header line.
+		size_t size = 0;
+	};
 
-	return mesh;
+	// Returns an error message, or an empty string on success.
+	string parsePlyHeader(const char* data, size_t size, PlyHeader& header) {
+		const char* end = data + size;
+		const char* p = data;
+		for (bool first = true; p < end; first = false) {
+			const char* lineEnd = nextLine(p, end);
+			istringstream line(string(p, lineEnd));
+			p = lineEnd;
+			string keyword;
+			line >> keyword;
+			if (first) {
+				if (keyword != "ply") return "not a PLY file";
+			}
+			else if (keyword == "format") {
+				string format;
+				line >> format;
+				if (format == "ascii") header.format = PLY_ASCII;
+				else if (format == "binary_little_endian") header.format = PLY_BINARY_LITTLE_ENDIAN;
+				else if (format == "binary_big_endian") header.format = PLY_BINARY_BIG_ENDIAN;
+				else return "unknown format \"" + format + "\"";
+			}
+			else if (keyword == "comment" || keyword == "obj_info") {
+				string comment;
+				getline(line >> ws, comment);
+				if (!comment.empty() && comment.back() == '\r') comment.pop_back();
+				header.comments.push_back(comment);
+			}
+			else if (keyword == "element") {
+				PlyHeaderElement element;
+				line >> element.name >> element.count;
+				if (line.fail()) return "malformed element";
+				header.elements.push_back(element);
+			}
+			else if (keyword == "property") {
+				if (header.elements.empty()) return "property before the first element";
+				PlyHeaderProperty property;
+				string type, countType;
+				line >> type;
+				if (type == "list") {
+					line >> countType >> type;
+					property.countType = plyType(countType);
+				}
+				property.type = plyType(type);
+				line >> property.name;
+				if (line.fail() || property.type == PLY_INVALID || (!countType.empty() && property.countType == PLY_INVALID)) {
+					return "malformed property";
+				}
+				header.elements.back().properties.push_back(property);
+			}
+			else if (keyword == "end_header") {
+				header.size = size_t(p - data);
+				for (PlyHeaderElement& element : header.elements) {
+					size_t offset = 0;
+					bool hasList = false;
+					for (PlyHeaderProperty& property : element.properties) {
+						property.offset = offset;
+						hasList |= property.countType != PLY_INVALID;
+						offset += PLY_TYPE_SIZES[property.type];
+					}
+					element.stride = hasList ? 0 : offset;
+				}
+				return "";
+			}
+			else if (!keyword.empty()) {
+				return "unknown header line \"" + keyword + "\"";
+			}
+		}
+		return "missing end_header";
+	}
+
+	// Reads values one after another in either encoding; used wherever records can't be
+	// addressed directly (ASCII files, elements with lists).
+	struct PlyReader {
+		const char* p;
+		const char* end;
+		PlyFormat format;
+		bool swapBytes;
+
+		bool read(PlyType type, double& value) {
+			if (format == PLY_ASCII) {
+				while (p < end && (isBlank(*p) || *p == '\n')) p++;
+				if (type == PLY_FLOAT32 || type == PLY_FLOAT64) {
+					float v = 0.0f;
+					p = parseFloat(p, end, v);
+					value = v;
+				}
+				else {
+					long long v = 0;
+					p = parseInt(p, end, v);
+					value = double(v);
+				}
+				return p != nullptr;
+			}
+			const size_t size = PLY_TYPE_SIZES[type];
+			if (size_t(end - p) < size) {
+				return false;
+			}
+			dispatchPlyType(type, [&](auto tag) {
+				using T = decltype(tag);
+				value = double(swapBytes ? loadPlyValue<T, true>(p) : loadPlyValue<T, false>(p));
+			});
+			p += size;
+			return true;
+		}
+
+		// Reads one record; values of list property i go to lists[i] if it is given, scalars to scalars[i].
+		bool readRecord(const PlyHeaderElement& element, double* scalars, vector<double>* lists) {
+			for (size_t i = 0; i < element.properties.size(); i++) {
+				const PlyHeaderProperty& property = element.properties[i];
+				if (property.countType == PLY_INVALID) {
+					if (!read(property.type, scalars[i])) return false;
+					continue;
+				}
+				double length;
+				if (!read(property.countType, length) || length < 0.0) return false;
+				if (lists) lists[i].resize(size_t(length));
+				for (size_t j = 0; j < size_t(length); j++) {
+					double value;
+					if (!read(property.type, value)) return false;
+					if (lists) lists[i][j] = value;
+				}
+			}
+			return true;
+		}
+	};
+
+	// Converts K properties of the same type from every fixed-size record into K floats per
+	// record of dst. Instantiated per type and byte order so the inner loop is a plain load,
+	// optional bswap and convert.
+	template<typename In, bool Swap, int K>
+	void convertPlyColumns(const char* records, size_t stride, const size_t* offsets, size_t count, float* dst) {
+#pragma omp parallel for
+		for (int i = 0; i < (int)count; i++) {
+			const char* record = records + size_t(i) * stride;
+			for (int k = 0; k < K; k++) {
+				dst[size_t(K) * i + k] = float(loadPlyValue<In, Swap>(record + offsets[k]));
+			}
+		}
+	}
+
+	// Reads triangle lists with a fixed record size straight into indices. Returns false, leaving
+	// indices partly written, if a face is not a triangle.
+	template<typename Count, typename Index, bool Swap>
+	bool convertPlyTriangles(const char* records, size_t stride, size_t countOffset, size_t count,
+		size_t vertexCount, unsigned int* indices, bool& invalidIndex) {
+		bool allTriangles = true;
+		bool invalid = false;
+		const size_t indexOffset = countOffset + sizeof(Count);
+#pragma omp parallel for reduction(&& : allTriangles) reduction(|| : invalid)
+		for (int i = 0; i < (int)count; i++) {
+			const char* record = records + size_t(i) * stride;
+			allTriangles = allTriangles && loadPlyValue<Count, Swap>(record + countOffset) == 3;
+			for (int k = 0; k < 3; k++) {
+				const Index index = loadPlyValue<Index, Swap>(record + indexOffset + k * sizeof(Index));
+				invalid = invalid || index < 0 || size_t(index) >= vertexCount;
+				indices[3 * size_t(i) + k] = (unsigned int)index;
+			}
+		}
+		invalidIndex = invalid;
+		return allTriangles;
+	}
+
+	// Vertex properties read by loadPly; alternatives in order of preference.
+	struct PlyVertexAttribute {
+		vector<vector<const char*>> names;
+		vector<int> properties;
+		float* dst = nullptr;
+	};
 }
 
-TriMesh TriMeshLoader::loadStl(string& filepath) {
+TriMesh TriMeshLoader::loadPly(string& filepath) {
+	PROFILE_SCOPE("TriMeshLoader::loadPly");
 	TriMesh mesh;
+	MappedFile file(filepath);
+	const char* data = file.data();
+	const char* end = data + file.size();
+	auto fail = [&](const string& message) {
+		fprintf(stderr, "%s: %s\n", filepath.c_str(), message.c_str());
+		exit(1);
+	};
+
+	PlyHeader header;
+	string error = parsePlyHeader(data, file.size(), header);
+	if (!error.empty()) {
+		fail(error);
+	}
+	if (verbose) {
+		std::cout << "........................................................................\n";
+		for (auto c : header.comments) std::cout << "Comment: " << c << std::endl;
+		for (auto e : header.elements)
+		{
+			std::cout << "element - " << e.name << " (" << e.count << ")" << std::endl;
+			for (auto p : e.properties) std::cout << "\tproperty - " << p.name << " (" << PLY_TYPE_NAMES[p.type] << ")" << std::endl;
+		}
+		std::cout << "........................................................................\n";
+	}
 
-	int faceN = 0;
+	const uint16_t one = 1;
+	const bool hostLittleEndian = *reinterpret_cast<const unsigned char*>(&one) == 1;
+	const bool swapBytes = header.format != PLY_ASCII && (header.format == PLY_BINARY_LITTLE_ENDIAN) != hostLittleEndian;
+	PlyReader reader{ data + header.size, end, header.format, swapBytes };
+	bool hasVertices = false, hasFaces = false;
+	vector<int> strips;
 
-	FILE* in = fopen(filepath.c_str(), "r+b");
-	fseek(in, 80, SEEK_SET);
-	fread(&faceN, 4, 1, in);
+	for (const PlyHeaderElement& element : header.elements) {
+		const bool binaryRecords = header.format != PLY_ASCII && element.stride > 0;
+		if (binaryRecords && element.count > size_t(end - reader.p) / element.stride) {
+			fail("unexpected end of file in element \"" + element.name + "\"");
+		}
+
+		if (element.name == "vertex" && !hasVertices) {
+			PROFILE_SCOPE("vertices");
+			hasVertices = true;
+			PlyVertexAttribute attributes[3] = {
+				{ { { "x" }, { "y" }, { "z" } } },
+				{ { { "nx" }, { "ny" }, { "nz" } } },
+				{ { { "u", "s", "texture_u", "texture_s" }, { "v", "t", "texture_v", "texture_t" } } },
+			};
+			for (PlyVertexAttribute& attribute : attributes) {
+				for (const vector<const char*>& names : attribute.names) {
+					attribute.properties.push_back(element.find(names));
+				}
+				if (find(attribute.properties.begin(), attribute.properties.end(), -1) != attribute.properties.end()) {
+					attribute.properties.clear();
+				}
+			}
+			if (attributes[0].properties.empty()) {
+				fail("vertices without x, y and z");
+			}
+			// data() of an empty element is null, which leaves nothing to convert.
+			mesh.vertices.resize(element.count);
+			attributes[0].dst = reinterpret_cast<float*>(mesh.vertices.data());
+			if (!attributes[1].properties.empty()) {
+				mesh.normals.resize(element.count);
+				attributes[1].dst = reinterpret_cast<float*>(mesh.normals.data());
+			}
+			if (!attributes[2].properties.empty()) {
+				mesh.uvs.resize(element.count);
+				attributes[2].dst = reinterpret_cast<float*>(mesh.uvs.data());
+			}
 
-	vector<glm::vec3> buff;
-	char dummy[10];
+			for (PlyVertexAttribute& attribute : attributes) {
+				if (!attribute.dst || !binaryRecords) {
+					continue;
+				}
+				const PlyType type = element.properties[attribute.properties[0]].type;
+				size_t offsets[3];
+				bool sameType = true;
+				for (size_t k = 0; k < attribute.properties.size(); k++) {
+					offsets[k] = element.properties[attribute.properties[k]].offset;
+					sameType &= element.properties[attribute.properties[k]].type == type;
+				}
+				if (!sameType) {
+					continue;
+				}
+				dispatchPlyType(type, [&](auto tag) {
+					using In = decltype(tag);
+					if (attribute.properties.size() == 3) {
+						(swapBytes ? convertPlyColumns<In, true, 3> : convertPlyColumns<In, false, 3>)(reader.p, element.stride, offsets, element.count, attribute.dst);
+					}
+					else {
+						(swapBytes ? convertPlyColumns<In, true, 2> : convertPlyColumns<In, false, 2>)(reader.p, element.stride, offsets, element.count, attribute.dst);
+					}
+				});
+				attribute.dst = nullptr;
+			}
 
-	int id = 0;
-	float n[3], v[3];
-	for (int i = 0; i < (int)faceN; i++) {
-		fread(n, sizeof(float), 3, in);
-		for (int j = 0; j < 3; j++) {
-			glm::vec3 vertex;
-			fread(v, sizeof(float), 3, in);
-			vertex[0] = v[0];
-			vertex[1] = v[1];
-			vertex[2] = v[2];
-			mesh.addVertex(vertex);
+			const bool columnsDone = none_of(std::begin(attributes), std::end(attributes),
+				[](const PlyVertexAttribute& attribute) { return attribute.dst != nullptr; });
+			if (binaryRecords && columnsDone) {
+				reader.p += element.count * element.stride;
+			}
+			// ASCII, lists in the element or mixed types within an attribute: read record by
+			// record, for the attributes not converted above.
+			else {
+				vector<double> scalars(element.properties.size());
+				for (size_t i = 0; i < element.count; i++) {
+					if (!reader.readRecord(element, scalars.data(), nullptr)) {
+						fail("malformed vertex " + to_string(i));
+					}
+					for (const PlyVertexAttribute& attribute : attributes) {
+						if (!attribute.dst) continue;
+						const size_t k = attribute.properties.size();
+						for (size_t j = 0; j < k; j++) {
+							attribute.dst[k * i + j] = float(scalars[attribute.properties[j]]);
+						}
+					}
+				}
+			}
 		}
-		unsigned int index[] = { 3 * i + 0,3 * i + 1,3 * i + 2 };
-		mesh.addFace(index);
-		fread(dummy, sizeof(char), 2, in);
+
+		else if ((element.name == "face" || element.name == "tristrips") && element.find({ "vertex_indices", "vertex_index" }) >= 0) {
+			PROFILE_SCOPE("faces");
+			if (!hasVertices) {
+				fail("faces before vertices");
+			}
+			hasFaces = true;
+			const bool isStrip = element.name == "tristrips";
+			const int list = element.find({ "vertex_indices", "vertex_index" });
+			const PlyHeaderProperty& indices = element.properties[list];
+			const size_t vertexCount = mesh.vertices.size();
+
+			// Binary triangle lists as the only list property have a fixed record size as long as
+			// every face is a triangle, so they can be converted in parallel; anything else is
+			// walked sequentially.
+			bool converted = false;
+			size_t stride = 0;
+			for (size_t i = 0; i < element.properties.size(); i++) {
+				const PlyHeaderProperty& property = element.properties[i];
+				stride += PLY_TYPE_SIZES[property.type] * (int(i) == list ? 3 : 1) +
+					(property.countType == PLY_INVALID ? 0 : PLY_TYPE_SIZES[property.countType]);
+			}
+			const bool onlyList = count_if(element.properties.begin(), element.properties.end(),
+				[](const PlyHeaderProperty& property) { return property.countType != PLY_INVALID; }) == 1;
+			const bool integerIndices = indices.type != PLY_FLOAT32 && indices.type != PLY_FLOAT64 &&
+				indices.countType != PLY_FLOAT32 && indices.countType != PLY_FLOAT64;
+			if (!isStrip && header.format != PLY_ASCII && onlyList && integerIndices &&
+				element.count <= size_t(end - reader.p) / stride) {
+				const size_t faceBase = mesh.verIndices.size();
+				mesh.verIndices.resize(faceBase + 3 * element.count);
+				bool invalidIndex = false;
+				dispatchPlyType(indices.countType, [&](auto countTag) {
+					dispatchPlyType(indices.type, [&](auto indexTag) {
+						using Count = decltype(countTag);
+						using Index = decltype(indexTag);
+						if constexpr (is_integral<Count>::value && is_integral<Index>::value) {
+							converted = (swapBytes ? convertPlyTriangles<Count, Index, true> : convertPlyTriangles<Count, Index, false>)(
+								reader.p, stride, indices.offset, element.count, vertexCount, mesh.verIndices.data() + faceBase, invalidIndex);
+						}
+					});
+				});
+				if (converted) {
+					if (invalidIndex) {
+						fail("vertex index out of range");
+					}
+					reader.p += element.count * stride;
+				}
+				else {
+					mesh.verIndices.resize(faceBase);
+				}
+			}
+
+			if (!converted) {
+				vector<double> scalars(element.properties.size());
+				vector<vector<double>> lists(element.properties.size());
+				mesh.verIndices.reserve(mesh.verIndices.size() + 3 * element.count);
+				for (size_t i = 0; i < element.count; i++) {
+					if (!reader.readRecord(element, scalars.data(), lists.data())) {
+						fail("malformed " + element.name + " " + to_string(i));
+					}
+					const vector<double>& polygon = lists[list];
+					for (double index : polygon) {
+						if (index < (isStrip ? -1.0 : 0.0) || index >= double(vertexCount)) {
+							fail("vertex index out of range");
+						}
+					}
+					if (isStrip) {
+						strips.insert(strips.end(), polygon.begin(), polygon.end());
+						strips.push_back(-1);
+						continue;
+					}
+					// Polygons become triangle fans; faces with less than three corners are dropped.
+					for (size_t k = 1; k + 1 < polygon.size(); k++) {
+						mesh.verIndices.push_back((unsigned int)polygon[0]);
+						mesh.verIndices.push_back((unsigned int)polygon[k]);
+						mesh.verIndices.push_back((unsigned int)polygon[k + 1]);
+					}
+				}
+			}
+		}
+
+		else if (binaryRecords) {
+			reader.p += element.count * element.stride;
+		}
+		else {
+			vector<double> scalars(element.properties.size());
+			for (size_t i = 0; i < element.count; i++) {
+				if (!reader.readRecord(element, scalars.data(), nullptr)) {
+					fail("malformed " + element.name + " " + to_string(i));
+				}
+			}
+		}
+	}
+	if (!hasVertices || !hasFaces) {
+		fail("no vertices or faces");
+	}
+
+	// Strips restart at index -1; every other triangle is flipped to keep the winding.
+	size_t runStart = 0;
+	for (size_t i = 0; i < strips.size(); i++) {
+		if (strips[i] < 0) {
+			runStart = i + 1;
+			continue;
+		}
+		if (i < runStart + 2) {
+			continue;
+		}
+		unsigned int index[3] = { (unsigned int)strips[i - 2], (unsigned int)strips[i - 1], (unsigned int)strips[i] };
+		if (index[0] == index[1] || index[1] == index[2] || index[0] == index[2]) {
+			continue;
+		}
+		if ((i - runStart) % 2 == 1) {
+			swap(index[0], index[1]);
+		}
+		mesh.verIndices.insert(mesh.verIndices.end(), index, index + 3);
+	}
+
+	mesh.verN = (unsigned int)mesh.vertices.size();
+	mesh.faceN = (unsigned int)(mesh.verIndices.size() / 3);
+	mesh.uvN = (unsigned int)mesh.uvs.size();
+	if (verbose) {
+		std::cout << "\tRead " << mesh.verN << " total vertices " << std::endl;
+		if (!mesh.normals.empty()) std::cout << "\tRead " << mesh.normals.size() << " total vertex normals " << std::endl;
+		if (!mesh.uvs.empty()) std::cout << "\tRead " << mesh.uvN << " total vertex texcoords " << std::endl;
+		std::cout << "\tRead " << mesh.faceN << " total faces (triangles) " << std::endl;
+	}
+	return mesh;
+}
+
+
+TriMesh TriMeshLoader::loadStl(string& filepath) {
+	PROFILE_SCOPE("TriMeshLoader::loadStl");
+	// Binary STL: 80-byte header, uint32 face count, then per face a normal, three corners
+	// (12 little-endian floats) and a 2-byte attribute.
+	const size_t STL_HEADER_SIZE = 84;
+	const size_t STL_RECORD_SIZE = 50;
+
+	TriMesh mesh;
+	MappedFile file(filepath);
+	const char* data = file.data();
+	if (file.size() < STL_HEADER_SIZE) {
+		fprintf(stderr, "\"%s\" is too short for a binary STL file.\n", filepath.c_str());
+		exit(1);
+	}
+	uint32_t faceN = 0;
+	memcpy(&faceN, data + 80, sizeof(faceN));
+	const size_t expected = STL_HEADER_SIZE + size_t(faceN) * STL_RECORD_SIZE;
+	if (file.size() < expected) {
+		if (strncmp(data, "solid", 5) == 0) {
+			fprintf(stderr, "\"%s\" looks like an ASCII STL file, only binary STL is supported.\n", filepath.c_str());
+		}
+		else {
+			fprintf(stderr, "\"%s\" declares %u faces (%zu bytes) but has %zu bytes.\n",
+				filepath.c_str(), faceN, expected, file.size());
+		}
+		exit(1);
+	}
+	if (file.size() > expected && verbose) {
+		printf("Ignoring %zu bytes after the last face of \"%s\".\n", file.size() - expected, filepath.c_str());
 	}
-	fclose(in);
 
+	vector<glm::vec3> corners(size_t(faceN) * 3);
+	{
+		PROFILE_SCOPE("read records");
+		const char* records = data + STL_HEADER_SIZE;
+#pragma omp parallel for
+		for (int i = 0; i < (int)faceN; i++) {
+			// Records are 50 bytes apart, so the floats are not aligned.
+			memcpy(glm::value_ptr(corners[3 * size_t(i)]), records + size_t(i) * STL_RECORD_SIZE + 12, 3 * sizeof(glm::vec3));
+		}
+	}
+
+	vector<unsigned int> remap;
+	mesh.verN = VertexWelder::weld(corners, mesh.vertices, remap);
+	mesh.verIndices = move(remap);
+	mesh.faceN = faceN;
+	if (verbose) {
+		printf("%u faces, %u of %zu corners are distinct\n", mesh.faceN, mesh.verN, corners.size());
+	}
 	return mesh;
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 
 #include<filesystem>
 #include"TriMesh.h"
+#include"MeshCache.h"
 #include "core/common.h"
 using namespace tinyply;
 
@@ -12,27 +13,92 @@ namespace fs = std::filesystem;
 
 class TriMeshLoader {
 public:
+	// Prints the file header and element counts while loading.
+	bool verbose = true;
+	// Reads and writes the ".tmesh" cache next to the loaded file.
+	bool useCache = true;
+	// TriMeshDerived mask of the derived data built right after loading, and so also cached;
+	// the rest is built on first use. The default is what VertexArrayObjectForMesh and the mesh
+	// viewers use.
+	unsigned int derived = DERIVED_VER_NORMALS | DERIVED_AABB;
+	// Reorders the faces and vertices for the vertex cache (TriMesh::optimizeRenderOrder()) once,
+	// before the mesh is cached, so that meshes for drawing don't pay for it on every load.
+	bool optimizeRenderOrder = false;
+	MeshOptimizer::Options renderOrderOptions;
+
 	TriMeshLoader() = default;
 
-	TriMesh load(string filepath) {
+	// Reads the mesh of filepath and builds the derived data. Unless useCache is false, all of
+	// it is cached in filepath + ".tmesh" and read from there as long as the cache is newer
+	// than the file. With bvh, the BVH of the mesh is built (or read from the cache) as well.
+	TriMesh load(string filepath, BVH* bvh = nullptr) {
+		PROFILE_SCOPE("TriMeshLoader::load");
 		TriMesh mesh;
 		string extension = fs::path(filepath).extension().string();
-		if (extension == ".obj") {
-			mesh = loadOBJ(filepath);
+		const bool isCache = extension == MESH_CACHE_EXTENSION;
+		const string cachePath = isCache ? filepath : filepath + MESH_CACHE_EXTENSION;
+		bool cached = false;
+		if (bvh) {
+			bvh->nodes.clear();
+		}
+		if (isCache || (useCache && MeshCache::isFresh(cachePath, filepath))) {
+			cached = MeshCache::load(cachePath, mesh, bvh);
+			if (!cached && isCache) {
+				fprintf(stderr, "\"%s\" is not a mesh cache of version %u.\n", filepath.c_str(), MESH_CACHE_VERSION);
+				exit(1);
+			}
+		}
+		if (!cached) {
+			if (extension == ".obj") {
+				mesh = loadOBJ(filepath);
+			}
+			else if (extension == ".ply") {
+				mesh = loadPly(filepath);
+			}
+			else if (extension == ".stl") {
+				mesh = loadStl(filepath);
+			}
+			else {
+				fprintf(stderr, "file format or file extension is not valid");
+				exit(1);
+			}
+		}
+		bool reordered = false;
+		if (optimizeRenderOrder && !mesh.isRenderOrderOptimized()) {
+			const MeshOptimizer::Stats stats = mesh.optimizeRenderOrder(renderOrderOptions);
+			reordered = true;
+			if (verbose) {
+				printf("Reordered %u faces for a %u-entry vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+					mesh.faceN, renderOrderOptions.cacheSize, stats.before.acmr, stats.after.acmr,
+					stats.before.atvr, stats.after.atvr);
+			}
+			// A cached BVH indexes the old face order.
+			if (bvh) {
+				bvh->nodes.clear();
+			}
 		}
-		else if (extension == ".ply") {
-			mesh = loadPly(filepath);
+		const bool missingDerived = (derived & ~mesh.freshDerived()) != 0;
+		mesh.updateDerived(derived);
+		// Only a means to build the rest.
+		mesh.releaseDerived(DERIVED_POSITIONS_SOA & ~derived);
+		const bool buildBvh = bvh && bvh->nodes.empty();
+		if (buildBvh) {
+			bvh->build(mesh);
 		}
-		else if (extension == ".stl") {
-			mesh = loadStl(filepath);
+		if (useCache && !isCache && (!cached || buildBvh || missingDerived || reordered)) {
+			// Adding derived data to a cache must not drop the BVH it holds.
+			BVH cachedBvh;
+			if (cached && !bvh && !reordered) {
+				MeshCache::loadBvh(cachePath, cachedBvh);
+			}
+			MeshCache::save(cachePath, mesh, bvh ? bvh : &cachedBvh, filepath);
 		}
-		else {
-			fprintf(stderr, "file format or file extension is not valid");
-			exit(1);
+		if (verbose && cached) {
+			printf("Read %s (%u vertices, %u faces%s)\n", cachePath.c_str(), mesh.verN, mesh.faceN,
+				bvh && !buildBvh ? ", BVH" : "");
 		}
-		mesh.computeFaceCenters();
-		mesh.computeFaceNormals();
-		mesh.filename = fs::path(filepath).stem().string();
+		fs::path name = fs::path(filepath).stem();
+		mesh.filename = (isCache ? name.stem() : name).string();
 		return mesh;
 	}
 private:
@@ -0,0 +1,112 @@
+#pragma once
+
+#ifndef VERTEX_FACE_ADJACENCY_H
+#define VERTEX_FACE_ADJACENCY_H
+
+#include "core/common.h"
+#include "core/Profiler.h"
+
+#include <atomic>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Faces around every vertex in compressed sparse row form. The corners of vertex v are
+// corners[offsets[v] .. offsets[v + 1]), where corner c is vertex c % 3 of face c / 3, in
+// increasing order, so per-vertex sums over them have the same order as a loop over the faces.
+struct VertexFaceAdjacency {
+    vector<unsigned int> offsets;
+    vector<unsigned int> corners;
+
+    unsigned int valence(unsigned int v) const {
+        return offsets[v + 1] - offsets[v];
+    }
+
+    const unsigned int *begin(unsigned int v) const {
+        return corners.data() + offsets[v];
+    }
+
+    const unsigned int *end(unsigned int v) const {
+        return corners.data() + offsets[v + 1];
+    }
+
+    // verIndices has three entries per face, all below verN.
+    void build(const vector<unsigned int> &verIndices, unsigned int verN) {
+        PROFILE_SCOPE("VertexFaceAdjacency::build");
+        const int cornerN = (int)verIndices.size();
+        int blockN = 1;
+#ifdef _OPENMP
+        blockN = omp_get_max_threads();
+#endif
+        // A single thread fills the lists in corner order without atomic read-modify-writes.
+        const bool parallel = blockN > 1;
+        vector<atomic<unsigned int>> cursor(verN);
+#pragma omp parallel for
+        for (int v = 0; v < (int)verN; v++) {
+            cursor[v].store(0, memory_order_relaxed);
+        }
+        if (parallel) {
+#pragma omp parallel for
+            for (int c = 0; c < cornerN; c++) {
+                cursor[verIndices[c]].fetch_add(1, memory_order_relaxed);
+            }
+        } else {
+            for (int c = 0; c < cornerN; c++) {
+                atomic<unsigned int> &count = cursor[verIndices[c]];
+                count.store(count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+            }
+        }
+
+        // Exclusive prefix sum of the valences: per-block sums, a short serial scan over the
+        // blocks, then the blocks again with their start.
+        offsets.resize(size_t(verN) + 1);
+        vector<unsigned int> blockSums(blockN + 1, 0);
+#pragma omp parallel for schedule(static, 1)
+        for (int b = 0; b < blockN; b++) {
+            const size_t first = size_t(verN) * b / blockN, last = size_t(verN) * (b + 1) / blockN;
+            unsigned int sum = 0;
+            for (size_t v = first; v < last; v++) {
+                sum += cursor[v].load(memory_order_relaxed);
+            }
+            blockSums[b + 1] = sum;
+        }
+        for (int b = 0; b < blockN; b++) {
+            blockSums[b + 1] += blockSums[b];
+        }
+#pragma omp parallel for schedule(static, 1)
+        for (int b = 0; b < blockN; b++) {
+            const size_t first = size_t(verN) * b / blockN, last = size_t(verN) * (b + 1) / blockN;
+            unsigned int sum = blockSums[b];
+            for (size_t v = first; v < last; v++) {
+                const unsigned int valence = cursor[v].load(memory_order_relaxed);
+                offsets[v] = sum;
+                cursor[v].store(sum, memory_order_relaxed);
+                sum += valence;
+            }
+        }
+        offsets[verN] = blockSums[blockN];
+
+        corners.resize(cornerN);
+        if (!parallel) {
+            for (int c = 0; c < cornerN; c++) {
+                atomic<unsigned int> &next = cursor[verIndices[c]];
+                const unsigned int slot = next.load(memory_order_relaxed);
+                next.store(slot + 1, memory_order_relaxed);
+                corners[slot] = (unsigned int)c;
+            }
+            return;
+        }
+#pragma omp parallel for
+        for (int c = 0; c < cornerN; c++) {
+            corners[cursor[verIndices[c]].fetch_add(1, memory_order_relaxed)] = (unsigned int)c;
+        }
+        // The fill order depends on the threads; sorting the short lists makes it canonical.
+#pragma omp parallel for schedule(dynamic, 1024)
+        for (int v = 0; v < (int)verN; v++) {
+            sort(corners.begin() + offsets[v], corners.begin() + offsets[v + 1]);
+        }
+    }
+};
+
+#endif //VERTEX_FACE_ADJACENCY_H
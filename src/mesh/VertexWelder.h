@@ -0,0 +1,283 @@
+#pragma once
+
+#ifndef VERTEX_WELDER_H
+#define VERTEX_WELDER_H
+
+#include "core/common.h"
+#include "core/Profiler.h"
+
+#include <array>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Welds vertices by sorting keys instead of hashing: every position is snapped to a grid with
+// spacing epsilon (or taken bitwise, with -0 == +0, for epsilon 0), the (key, index) pairs are
+// radix sorted in parallel and every run of equal keys becomes one vertex. The sort is stable,
+// so a run starts with its lowest index, and welded vertices keep the order of their first
+// occurrence; the result does not depend on the thread count.
+//
+// Snapping merges everything within a cell, but two positions closer than epsilon on either
+// side of a cell boundary stay apart.
+namespace VertexWelder {
+    // Per-vertex values that have to match exactly as well: values[components * i + c].
+    struct Attribute {
+        const float *values;
+        int components;
+    };
+
+    // At most this many key words: three for the position plus the attribute components.
+    const int MAX_KEY_WORDS = 12;
+
+    inline int threadCount() {
+#ifdef _OPENMP
+        return omp_get_max_threads();
+#else
+        return 1;
+#endif
+    }
+
+    inline uint32_t floatBits(float value) {
+        // -0 and +0 compare equal, so give them the same key.
+        value = value == 0.0f ? 0.0f : value;
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    // Grid cell of value along one axis, or its bits if inverseEpsilon is 0.
+    inline uint32_t quantize(float value, double inverseEpsilon) {
+        if (inverseEpsilon == 0.0) {
+            return floatBits(value);
+        }
+        const double cell = floor(double(value) * inverseEpsilon);
+        if (!(cell == cell)) {
+            return UINT32_MAX;
+        }
+        // Biased, so that nearby cells differ in the low bits only (see weldWithKeys).
+        return uint32_t(int32_t(glm::clamp(cell, double(INT32_MIN), double(INT32_MAX)))) ^ 0x80000000u;
+    }
+
+    template<int K>
+    struct Item {
+        uint32_t key[K];
+        uint32_t index;
+    };
+
+    // Stable LSD radix sort over all key words, 8 bits per pass. Each thread histograms and
+    // scatters its own block, so items keep their order within a digit. Passes where every
+    // item has the same digit (e.g. the high bytes of nearby grid cells) are skipped.
+    template<int K>
+    void radixSort(vector<Item<K>> &items) {
+        PROFILE_SCOPE("VertexWelder::radixSort");
+        const size_t n = items.size();
+        const int blockN = threadCount();
+        vector<Item<K>> buffer(n);
+        vector<array<size_t, 256>> histograms(blockN);
+        for (int pass = 0; pass < 4 * K; pass++) {
+            const int word = K - 1 - pass / 4;
+            const int shift = 8 * (pass % 4);
+#pragma omp parallel for schedule(static, 1)
+            for (int b = 0; b < blockN; b++) {
+                array<size_t, 256> &histogram = histograms[b];
+                histogram.fill(0);
+                for (size_t i = n * b / blockN; i < n * (b + 1) / blockN; i++) {
+                    histogram[(items[i].key[word] >> shift) & 0xff]++;
+                }
+            }
+            bool skip = false;
+            size_t offset = 0;
+            for (int d = 0; d < 256; d++) {
+                size_t total = 0;
+                for (int b = 0; b < blockN; b++) {
+                    const size_t count = histograms[b][d];
+                    histograms[b][d] = offset + total;
+                    total += count;
+                }
+                skip |= total == n;
+                offset += total;
+            }
+            if (skip) {
+                continue;
+            }
+#pragma omp parallel for schedule(static, 1)
+            for (int b = 0; b < blockN; b++) {
+                array<size_t, 256> &next = histograms[b];
+                for (size_t i = n * b / blockN; i < n * (b + 1) / blockN; i++) {
+                    buffer[next[(items[i].key[word] >> shift) & 0xff]++] = items[i];
+                }
+            }
+            items.swap(buffer);
+        }
+    }
+
+    template<int K>
+    void weldWithKeys(const vector<glm::vec3> &positions, double inverseEpsilon, const vector<Attribute> &attributes,
+                      vector<unsigned int> &remap, vector<unsigned int> &representatives) {
+        const int n = (int)positions.size();
+        vector<Item<K>> items(n);
+#pragma omp parallel for
+        for (int i = 0; i < n; i++) {
+            Item<K> &item = items[i];
+            for (int j = 0; j < 3; j++) {
+                item.key[j] = quantize(positions[i][j], inverseEpsilon);
+            }
+            // Without attributes K is 3, and the compiler can't tell that the loop is empty.
+            if constexpr (K > 3) {
+                int word = 3;
+                for (const Attribute &attribute : attributes) {
+                    for (int c = 0; c < attribute.components; c++) {
+                        item.key[word++] = floatBits(attribute.values[size_t(attribute.components) * i + c]);
+                    }
+                }
+            }
+            item.index = uint32_t(i);
+        }
+        // Subtracting the smallest value of every word clears the high bytes of compact
+        // ranges (grid cells of one mesh), whose radix passes are then skipped.
+        const int blockN = threadCount();
+        vector<array<uint32_t, K>> blockMins(blockN);
+#pragma omp parallel for schedule(static, 1)
+        for (int b = 0; b < blockN; b++) {
+            blockMins[b].fill(UINT32_MAX);
+            for (int i = int(size_t(n) * b / blockN); i < int(size_t(n) * (b + 1) / blockN); i++) {
+                for (int j = 0; j < K; j++) {
+                    blockMins[b][j] = min(blockMins[b][j], items[i].key[j]);
+                }
+            }
+        }
+        array<uint32_t, K> mins = blockMins[0];
+        for (int b = 1; b < blockN; b++) {
+            for (int j = 0; j < K; j++) {
+                mins[j] = min(mins[j], blockMins[b][j]);
+            }
+        }
+#pragma omp parallel for
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < K; j++) {
+                items[i].key[j] -= mins[j];
+            }
+        }
+        radixSort(items);
+
+        // Point every member of a run at its first (lowest) index: mark the sorted position of
+        // every run start, then carry the last start forward with a blocked parallel max-scan.
+        vector<unsigned int> heads(n);
+#pragma omp parallel for
+        for (int k = 0; k < n; k++) {
+            const bool start = k == 0 || memcmp(items[k].key, items[k - 1].key, sizeof(items[k].key)) != 0;
+            heads[k] = start ? (unsigned int)k : 0;
+        }
+        vector<unsigned int> blockHeads(blockN + 1, 0);
+#pragma omp parallel for schedule(static, 1)
+        for (int b = 0; b < blockN; b++) {
+            unsigned int head = 0;
+            for (int k = int(size_t(n) * b / blockN); k < int(size_t(n) * (b + 1) / blockN); k++) {
+                head = max(head, heads[k]);
+            }
+            blockHeads[b + 1] = head;
+        }
+        for (int b = 0; b < blockN; b++) {
+            blockHeads[b + 1] = max(blockHeads[b + 1], blockHeads[b]);
+        }
+        vector<unsigned int> first(n);
+        vector<unsigned char> isFirst(n, 0);
+#pragma omp parallel for schedule(static, 1)
+        for (int b = 0; b < blockN; b++) {
+            unsigned int head = blockHeads[b];
+            for (int k = int(size_t(n) * b / blockN); k < int(size_t(n) * (b + 1) / blockN); k++) {
+                head = max(head, heads[k]);
+                first[items[k].index] = items[head].index;
+                isFirst[items[k].index] = head == (unsigned int)k;
+            }
+        }
+        vector<unsigned int>().swap(heads);
+        vector<Item<K>>().swap(items);
+
+        // Number the first occurrences in input order with a blocked parallel prefix sum.
+        vector<unsigned int> ids(n);
+        vector<unsigned int> blockSums(blockN + 1, 0);
+#pragma omp parallel for schedule(static, 1)
+        for (int b = 0; b < blockN; b++) {
+            unsigned int sum = 0;
+            for (int i = int(size_t(n) * b / blockN); i < int(size_t(n) * (b + 1) / blockN); i++) {
+                sum += isFirst[i];
+            }
+            blockSums[b + 1] = sum;
+        }
+        for (int b = 0; b < blockN; b++) {
+            blockSums[b + 1] += blockSums[b];
+        }
+#pragma omp parallel for schedule(static, 1)
+        for (int b = 0; b < blockN; b++) {
+            unsigned int sum = blockSums[b];
+            for (int i = int(size_t(n) * b / blockN); i < int(size_t(n) * (b + 1) / blockN); i++) {
+                ids[i] = sum;
+                sum += isFirst[i];
+            }
+        }
+
+        remap.resize(n);
+        representatives.resize(blockSums[blockN]);
+#pragma omp parallel for
+        for (int i = 0; i < n; i++) {
+            remap[i] = ids[first[i]];
+            if (isFirst[i]) {
+                representatives[ids[i]] = (unsigned int)i;
+            }
+        }
+    }
+
+    // Fills remap[i] with the welded index of positions[i] and representatives[w] with the input
+    // vertex that welded vertex w is taken from (the first one of its cell). Vertices with
+    // attributes are only welded if all of their attribute values are bitwise equal.
+    inline void weld(const vector<glm::vec3> &positions, vector<unsigned int> &remap,
+                     vector<unsigned int> &representatives, float epsilon = 0.0f,
+                     const vector<Attribute> &attributes = {}) {
+        PROFILE_SCOPE("VertexWelder::weld");
+        int words = 3;
+        for (const Attribute &attribute : attributes) {
+            words += attribute.components;
+        }
+        const double inverseEpsilon = epsilon > 0.0f ? 1.0 / double(epsilon) : 0.0;
+        switch (words) {
+            case 3: weldWithKeys<3>(positions, inverseEpsilon, attributes, remap, representatives); break;
+            case 4: weldWithKeys<4>(positions, inverseEpsilon, attributes, remap, representatives); break;
+            case 5: weldWithKeys<5>(positions, inverseEpsilon, attributes, remap, representatives); break;
+            case 6: weldWithKeys<6>(positions, inverseEpsilon, attributes, remap, representatives); break;
+            case 7: weldWithKeys<7>(positions, inverseEpsilon, attributes, remap, representatives); break;
+            case 8: weldWithKeys<8>(positions, inverseEpsilon, attributes, remap, representatives); break;
+            case 9: weldWithKeys<9>(positions, inverseEpsilon, attributes, remap, representatives); break;
+            case 10: weldWithKeys<10>(positions, inverseEpsilon, attributes, remap, representatives); break;
+            case 11: weldWithKeys<11>(positions, inverseEpsilon, attributes, remap, representatives); break;
+            case 12: weldWithKeys<12>(positions, inverseEpsilon, attributes, remap, representatives); break;
+            default:
+                fprintf(stderr, "Can't weld on more than %d attribute components.\n", MAX_KEY_WORDS - 3);
+                exit(1);
+        }
+    }
+
+    // values[representatives[w]] for every welded vertex w.
+    template<typename T>
+    vector<T> gather(const vector<T> &values, const vector<unsigned int> &representatives) {
+        vector<T> welded(representatives.size());
+#pragma omp parallel for
+        for (int w = 0; w < (int)representatives.size(); w++) {
+            welded[w] = values[representatives[w]];
+        }
+        return welded;
+    }
+
+    // Exact welding of positions alone; fills welded with the distinct positions and returns
+    // their number.
+    inline unsigned int weld(const vector<glm::vec3> &positions, vector<glm::vec3> &welded,
+                             vector<unsigned int> &remap) {
+        vector<unsigned int> representatives;
+        weld(positions, remap, representatives);
+        welded = gather(positions, representatives);
+        return (unsigned int)welded.size();
+    }
+} // namespace VertexWelder
+
+#endif //VERTEX_WELDER_H
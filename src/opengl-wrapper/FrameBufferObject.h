@@ -27,12 +27,22 @@ public:
         height = height_;
     }
 
-    void attachColorTexture(Texture2D &tex) {
+    void attachColorTexture(Texture2D &tex, int index = 0) {
         glBindFramebuffer(GL_FRAMEBUFFER, fboId);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex.textureId, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + index, GL_TEXTURE_2D, tex.textureId, 0);
         //glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
+    // Enables fragment outputs 0..n-1 (GL_COLOR_ATTACHMENT0..n-1).
+    void setDrawBuffers(int n) {
+        vector<GLenum> buffers(n);
+        for (int i = 0; i < n; i++) {
+            buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+        glDrawBuffers(n, buffers.data());
+    }
+
     void attachColorTexture(Texture2DArray &texArray, const GLint layer) {
         glBindFramebuffer(GL_FRAMEBUFFER, fboId);
         glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texArray.textureArrayId, 0, layer);
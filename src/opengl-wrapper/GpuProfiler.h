@@ -0,0 +1,263 @@
+#pragma once
+
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include "core/common.h"
+
+// GPU time of named passes, measured with GL_TIMESTAMP queries written by glQueryCounter.
+// Timestamps (rather than GL_TIME_ELAPSED) allow nested passes and passes inside a running
+// TimerQuery, and place every pass on one timeline for the trace.
+//
+// Queries are double-buffered by frame: the queries of frame N are read back in
+// beginFrame() of frame N + 2, when the GPU has long finished them. Each pass feeds a
+// log-scale histogram, and every measured interval can be written as a Chrome trace
+// (chrome://tracing or https://ui.perfetto.dev).
+//
+//   profiler.beginFrame();
+//   profiler.begin("trace");
+//   ...draw calls...
+//   profiler.end();
+class GpuProfiler {
+public:
+    // Bin i holds durations in [2^(i / 4), 2^((i + 1) / 4)) microseconds; the first and last
+    // bins also take everything below / above.
+    static const int HISTOGRAM_BINS = 80;
+
+    struct PassStats {
+        string name;
+        int count = 0;
+        double totalMs = 0.0;
+        double minMs = DBL_MAX;
+        double maxMs = 0.0;
+        int histogram[HISTOGRAM_BINS] = {};
+
+        double meanMs() const {
+            return count > 0 ? totalMs / count : 0.0;
+        }
+
+        // Upper edge of the histogram bin containing the p-th fraction of the samples.
+        double percentileMs(double p) const {
+            const int rank = int(ceil(p * count));
+            int seen = 0;
+            for (int i = 0; i < HISTOGRAM_BINS; i++) {
+                seen += histogram[i];
+                if (seen >= rank && seen > 0) {
+                    return min(pow(2.0, (i + 1) / 4.0) / 1000.0, maxMs);
+                }
+            }
+            return maxMs;
+        }
+    };
+
+    // Off by default; disabled profilers issue no queries.
+    bool enabled = false;
+    // Intervals kept for the trace; later ones only go into the histograms.
+    size_t maxTraceEvents = 1000000;
+    vector<PassStats> passes;
+
+private:
+    struct PendingPass {
+        int pass;
+        int depth;
+        int frame;
+        int beginQuery;
+        int endQuery;
+    };
+
+    struct TraceEvent {
+        int pass;
+        int depth;
+        int frame;
+        GLuint64 beginNs;
+        GLuint64 endNs;
+    };
+
+    struct FrameQueries {
+        vector<GLuint> queryIds;
+        int used = 0;
+        vector<PendingPass> pending;
+    };
+
+    FrameQueries frames[2];
+    int current = 0;
+    int frameIndex = 0;
+    vector<size_t> openPasses;
+    vector<TraceEvent> events;
+    GLuint64 originNs = 0;
+
+public:
+    GpuProfiler() = default;
+    GpuProfiler(const GpuProfiler &) = delete;
+    GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+    ~GpuProfiler() {
+        for (FrameQueries &frame : frames) {
+            if (!frame.queryIds.empty()) {
+                glDeleteQueries(GLsizei(frame.queryIds.size()), frame.queryIds.data());
+            }
+        }
+    }
+
+    // Starts a new frame and collects the results of the frame that used the same queries.
+    // Passes can't span frames.
+    void beginFrame() {
+        if (!enabled) {
+            return;
+        }
+        if (!openPasses.empty()) {
+            fprintf(stderr, "GpuProfiler: pass \"%s\" is still open at the end of the frame.\n",
+                    passes[frames[current].pending[openPasses.back()].pass].name.c_str());
+            exit(1);
+        }
+        current ^= 1;
+        frameIndex++;
+        collect(frames[current]);
+    }
+
+    void begin(const char *name) {
+        if (!enabled) {
+            return;
+        }
+        FrameQueries &frame = frames[current];
+        PendingPass pass{passId(name), int(openPasses.size()), frameIndex, query(frame), -1};
+        glQueryCounter(frame.queryIds[pass.beginQuery], GL_TIMESTAMP);
+        openPasses.push_back(frame.pending.size());
+        frame.pending.push_back(pass);
+    }
+
+    void end() {
+        if (!enabled) {
+            return;
+        }
+        if (openPasses.empty()) {
+            fprintf(stderr, "GpuProfiler::end() without begin().\n");
+            exit(1);
+        }
+        FrameQueries &frame = frames[current];
+        PendingPass &pass = frame.pending[openPasses.back()];
+        openPasses.pop_back();
+        pass.endQuery = query(frame);
+        glQueryCounter(frame.queryIds[pass.endQuery], GL_TIMESTAMP);
+    }
+
+    // Collects every finished pass, waiting for the GPU. Call before reading the results.
+    void flush() {
+        collect(frames[current ^ 1]);
+        if (openPasses.empty()) {
+            collect(frames[current]);
+        }
+    }
+
+    void clear() {
+        flush();
+        passes.clear();
+        events.clear();
+        originNs = 0;
+    }
+
+    // One line per pass: count, mean, median, 95th percentile and max in milliseconds.
+    void printSummary(FILE *out = stdout) {
+        flush();
+        fprintf(out, "%-20s %8s %10s %10s %10s %10s\n", "GPU pass", "count", "mean ms", "p50 ms", "p95 ms", "max ms");
+        for (const PassStats &pass : passes) {
+            fprintf(out, "%-20s %8d %10.3f %10.3f %10.3f %10.3f\n", pass.name.c_str(), pass.count, pass.meanMs(),
+                    pass.percentileMs(0.5), pass.percentileMs(0.95), pass.maxMs);
+        }
+    }
+
+    // Writes the measured intervals in the Chrome trace event format; returns false if
+    // path can't be written.
+    bool writeChromeTrace(const string &path) {
+        flush();
+        ofstream file(path);
+        if (file.fail()) {
+            fprintf(stderr, "Can't write \"%s\".\n", path.c_str());
+            return false;
+        }
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+        char line[256];
+        for (const TraceEvent &event : events) {
+            snprintf(line, sizeof(line),
+                     ",\n{\"name\":\"%s\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,"
+                     "\"args\":{\"frame\":%d,\"depth\":%d}}",
+                     passes[event.pass].name.c_str(), double(event.beginNs - originNs) / 1e3,
+                     double(event.endNs - event.beginNs) / 1e3, event.frame, event.depth);
+            file << line;
+        }
+        file << "\n]}\n";
+        return !file.fail();
+    }
+
+private:
+    int passId(const char *name) {
+        for (size_t i = 0; i < passes.size(); i++) {
+            if (passes[i].name == name) {
+                return int(i);
+            }
+        }
+        passes.emplace_back();
+        passes.back().name = name;
+        return int(passes.size()) - 1;
+    }
+
+    int query(FrameQueries &frame) {
+        if (frame.used == int(frame.queryIds.size())) {
+            const size_t size = frame.queryIds.size();
+            frame.queryIds.resize(max(size * 2, size_t(16)));
+            glGenQueries(GLsizei(frame.queryIds.size() - size), frame.queryIds.data() + size);
+        }
+        return frame.used++;
+    }
+
+    void collect(FrameQueries &frame) {
+        for (const PendingPass &pending : frame.pending) {
+            GLuint64 beginNs = 0, endNs = 0;
+            glGetQueryObjectui64v(frame.queryIds[pending.beginQuery], GL_QUERY_RESULT, &beginNs);
+            glGetQueryObjectui64v(frame.queryIds[pending.endQuery], GL_QUERY_RESULT, &endNs);
+            record(pending, beginNs, max(endNs, beginNs));
+        }
+        frame.pending.clear();
+        frame.used = 0;
+    }
+
+    void record(const PendingPass &pending, GLuint64 beginNs, GLuint64 endNs) {
+        const double ms = double(endNs - beginNs) / 1e6;
+        PassStats &pass = passes[pending.pass];
+        pass.count++;
+        pass.totalMs += ms;
+        pass.minMs = min(pass.minMs, ms);
+        pass.maxMs = max(pass.maxMs, ms);
+        const double us = ms * 1000.0;
+        const int bin = us < 1.0 ? 0 : int(floor(4.0 * log2(us)));
+        pass.histogram[min(bin, HISTOGRAM_BINS - 1)]++;
+
+        if (events.size() < maxTraceEvents) {
+            if (events.empty() && originNs == 0) {
+                originNs = beginNs;
+            }
+            if (beginNs >= originNs) {
+                events.push_back(TraceEvent{pending.pass, pending.depth, pending.frame, beginNs, endNs});
+            }
+        }
+    }
+};
+
+// Measures the enclosing block as one pass.
+class GpuProfilerScope {
+private:
+    GpuProfiler &profiler;
+
+public:
+    GpuProfilerScope(GpuProfiler &profiler, const char *name)
+            : profiler(profiler) {
+        profiler.begin(name);
+    }
+
+    ~GpuProfilerScope() {
+        profiler.end();
+    }
+};
+
+#endif //GPU_PROFILER_H
@@ -6,12 +6,15 @@
 #include "Texture2D.h"
 #include "Texture2DArray.h"
 #include "Texture3D.h"
+#include "TextureBuffer.h"
 #include "core/common.h"
 
 class Shader {
 public:
     static filesystem::path shadersDir;
     GLuint program_id = 0;
+    // Looked up once per program; see uniform_location().
+    map<string, GLint> uniform_locations;
 
     ~Shader() {
         if (program_id != 0) {
@@ -23,6 +26,16 @@ public:
         vert_file = (shadersDir / vert_file).string();
         frag_file = (shadersDir / frag_file).string();
         program_id = build_shader_program(vert_file, frag_file);
+        uniform_locations.clear();
+    }
+
+    // -1 if the program has no active uniform of that name.
+    GLint uniform_location(const char *name) {
+        auto found = uniform_locations.find(name);
+        if (found == uniform_locations.end()) {
+            found = uniform_locations.emplace(name, glGetUniformLocation(program_id, name)).first;
+        }
+        return found->second;
     }
 
     GLuint compile_shader(const string filename, GLuint type) {
@@ -134,6 +147,11 @@ public:
         glUniform1i(loc_id, val);
     }
 
+    void set_uniform_value(unsigned int val, const char *val_name) {
+        GLuint loc_id = glGetUniformLocation(program_id, val_name);
+        glUniform1ui(loc_id, val);
+    }
+
     void set_uniform_texture(Texture2D &texture, const char *val_name) {
         texture.bind();
         glUniform1i(glGetUniformLocation(program_id, val_name), texture.textureUnit - GL_TEXTURE0);
@@ -149,6 +167,11 @@ public:
         glUniform1i(glGetUniformLocation(program_id, val_name), texture.textureUnit - GL_TEXTURE0);
     }
 
+    void set_uniform_texture(TextureBuffer &textureBuffer, const char *val_name) {
+        textureBuffer.bind();
+        glUniform1i(glGetUniformLocation(program_id, val_name), textureBuffer.textureUnit - GL_TEXTURE0);
+    }
+
     void bind() {
         glUseProgram(program_id);
     }
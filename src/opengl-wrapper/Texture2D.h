@@ -9,8 +9,9 @@ class Texture2D {
 public:
 	GLuint textureId = 0u;
 	GLenum textureUnit;
+	int width, height;
 	Texture2D(int width, int height, GLint internalformat, GLenum format, GLenum textureUnit = GL_TEXTURE0)
-		:textureUnit(textureUnit) {
+		:textureUnit(textureUnit),width(width),height(height) {
 		glActiveTexture(textureUnit);
 		glGenTextures(1, &textureId);
 		glBindTexture(GL_TEXTURE_2D, textureId);
@@ -29,6 +30,20 @@ public:
 		}
 	}
 
+	void setTexture(const void* data, GLenum format, GLenum type) {
+		bind();
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, data);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+
+	void getTexture(void* data, GLenum format, GLenum type) {
+		bind();
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_2D, 0, format, type, data);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	}
+
 	void bind() {
 		glActiveTexture(textureUnit);
 		glBindTexture(GL_TEXTURE_2D, textureId);
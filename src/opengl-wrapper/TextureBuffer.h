@@ -0,0 +1,51 @@
+#pragma once
+
+#ifndef TEXTURE_BUFFER_H
+#define TEXTURE_BUFFER_H
+
+#include "core/common.h"
+
+// Buffer object exposed to shaders as a samplerBuffer / usamplerBuffer (texelFetch only).
+class TextureBuffer {
+public:
+    GLuint bufferId = 0u;
+    GLuint textureId = 0u;
+    GLenum internalformat;
+    GLenum textureUnit;
+
+    TextureBuffer(GLenum internalformat, GLenum textureUnit = GL_TEXTURE0)
+            : internalformat(internalformat), textureUnit(textureUnit) {
+        glGenBuffers(1, &bufferId);
+        glGenTextures(1, &textureId);
+    }
+
+    ~TextureBuffer() {
+        if (textureId != 0) {
+            glDeleteTextures(1, &textureId);
+        }
+        if (bufferId != 0) {
+            glDeleteBuffers(1, &bufferId);
+        }
+    }
+
+    void setData(const void *data, size_t bytes) {
+        glBindBuffer(GL_TEXTURE_BUFFER, bufferId);
+        glBufferData(GL_TEXTURE_BUFFER, bytes, data, GL_STATIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        bind();
+        glTexBuffer(GL_TEXTURE_BUFFER, internalformat, bufferId);
+        release();
+    }
+
+    void bind() {
+        glActiveTexture(textureUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, textureId);
+    }
+
+    void release() {
+        glActiveTexture(textureUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+};
+
+#endif //TEXTURE_BUFFER_H
@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef TIMER_QUERY_H
+#define TIMER_QUERY_H
+
+#include "core/common.h"
+
+// GL_TIME_ELAPSED query with two query objects used alternately, so that reading
+// the result of the previous pass never stalls the pipeline.
+class TimerQuery {
+private:
+    GLuint queryIds[2] = {0, 0};
+    bool issued[2] = {false, false};
+    int tags[2] = {0, 0};
+    int current = 0;
+
+public:
+    TimerQuery() {
+        glGenQueries(2, queryIds);
+    }
+
+    ~TimerQuery() {
+        glDeleteQueries(2, queryIds);
+    }
+
+    void begin() {
+        glBeginQuery(GL_TIME_ELAPSED, queryIds[current]);
+    }
+
+    // tag is handed back by poll() together with the measured time.
+    void end(int tag = 0) {
+        glEndQuery(GL_TIME_ELAPSED);
+        issued[current] = true;
+        tags[current] = tag;
+        current ^= 1;
+    }
+
+    // Result of the oldest pending query (the one the next begin() reuses) in milliseconds.
+    // Returns false without waiting if the GPU has not finished it yet.
+    bool poll(double &ms, int *tag = nullptr) {
+        if (!issued[current]) {
+            return false;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(queryIds[current], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            return false;
+        }
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queryIds[current], GL_QUERY_RESULT, &ns);
+        issued[current] = false;
+        ms = double(ns) / 1e6;
+        if (tag) {
+            *tag = tags[current];
+        }
+        return true;
+    }
+};
+
+#endif //TIMER_QUERY_H
@@ -3,7 +3,8 @@
 #ifndef VAOMESH_H
 #define VAOMESH_H
 
-#include "mesh/Trimesh.h"
+#include "mesh/TriMesh.h"
+#include "Shader.h"
 #include "core/common.h"
 
 enum ShadingMethod {
@@ -12,91 +13,82 @@ enum ShadingMethod {
     SINOGRAM,
 };
 
+// Both shading methods draw the indexed vertex and vertex normal buffers. For FLAT_SHADING the
+// bound program gets u_flatShading = true, if it declares it, and is expected to replace the
+// interpolated normal by that of the triangle, e.g. in the fragment shader
+//
+//     uniform bool u_flatShading;
+//     ...
+//     vec3 n = u_flatShading ? normalize(cross(dFdx(v_position), dFdy(v_position))) : normalize(v_normal);
+//
+// with v_position the interpolated position in the space the normal is used in, as
+// mesh_render.frag and mesh_render_gooch.frag do. Programs without u_flatShading get the same
+// draw for both methods.
 class VertexArrayObjectForMesh {
     GLuint vaoId = 0;
-    GLuint flatVertexBufferId = 0;
-    GLuint flatNormalBufferId = 0;
-    GLuint smoothVertexBufferId = 0;
-    GLuint smoothNormalBufferId = 0;
+    GLuint vertexBufferId = 0;
+    GLuint normalBufferId = 0;
     GLuint indexBufferId = 0;
     shared_ptr<TriMesh> mesh;
 
 public:
-    VertexArrayObjectForMesh(shared_ptr<TriMesh> mesh) : mesh(mesh) {
+    // With optimizeOrder, the faces and vertices of the mesh are reordered in place for the
+    // vertex cache (once per mesh generation) before they are uploaded. Meshes loaded with
+    // TriMeshLoader::optimizeRenderOrder come in that order already, from the mesh cache.
+    VertexArrayObjectForMesh(shared_ptr<TriMesh> mesh, bool optimizeOrder = false,
+                             const MeshOptimizer::Options &optimizeOptions = {}) : mesh(mesh) {
+        if (optimizeOrder && !mesh->isRenderOrderOptimized()) {
+            mesh->optimizeRenderOrder(optimizeOptions);
+        }
         initialize();
     }
 
     void initialize() {
-        mesh->computeVerNormals();
-        mesh->computeFaceNormals();
+        // Usually built by TriMeshLoader already (or read from the mesh cache).
+        const vector<glm::vec3> &verNormals = mesh->getVerNormals();
         // VAO�̍쐬
         glGenVertexArrays(1, &vaoId);
         glBindVertexArray(vaoId);
 
         // ���_�o�b�t�@�̍쐬
-        glGenBuffers(1, &smoothVertexBufferId);
-        glBindBuffer(GL_ARRAY_BUFFER, smoothVertexBufferId);
+        glGenBuffers(1, &vertexBufferId);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferId);
         glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * mesh->vertices.size(), mesh->vertices.data(), GL_STATIC_DRAW);
 
-        glGenBuffers(1, &smoothNormalBufferId);
-        glBindBuffer(GL_ARRAY_BUFFER, smoothNormalBufferId);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * mesh->verNormals.size(), mesh->verNormals.data(), GL_STATIC_DRAW);
+        glGenBuffers(1, &normalBufferId);
+        glBindBuffer(GL_ARRAY_BUFFER, normalBufferId);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * verNormals.size(), verNormals.data(), GL_STATIC_DRAW);
 
         glGenBuffers(1, &indexBufferId);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferId);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * mesh->verIndices.size(), mesh->verIndices.data(), GL_STATIC_DRAW);
 
-        glGenBuffers(1, &flatVertexBufferId);
-        glBindBuffer(GL_ARRAY_BUFFER, flatVertexBufferId);
-        vector<glm::vec3> buffer(mesh->faceN * 3);
-        for (int i = 0; i < mesh->faceN; i++) {
-            buffer[3 * i + 0] = mesh->vertices[mesh->verIndices[3 * i + 0]];
-            buffer[3 * i + 1] = mesh->vertices[mesh->verIndices[3 * i + 1]];
-            buffer[3 * i + 2] = mesh->vertices[mesh->verIndices[3 * i + 2]];
-        }
-        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * buffer.size(), buffer.data(), GL_STATIC_DRAW);
-
-        glGenBuffers(1, &flatNormalBufferId);
-        glBindBuffer(GL_ARRAY_BUFFER, flatNormalBufferId);
-        for (int i = 0; i < mesh->faceN; i++) {
-            buffer[3 * i + 0] = mesh->faceNormals[i];
-            buffer[3 * i + 1] = mesh->faceNormals[i];
-            buffer[3 * i + 2] = mesh->faceNormals[i];
-        }
-        glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * buffer.size(), buffer.data(), GL_STATIC_DRAW);
-
         // VAO��OFF�ɂ��Ă���
         glBindVertexArray(0);
     }
 
-    void draw(ShadingMethod method) {
-        if (method == SMOOTH_SHADING) {
-            bind();
-            glBindBuffer(GL_ARRAY_BUFFER, smoothVertexBufferId);
-            glEnableVertexAttribArray(0);
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
-
-            glBindBuffer(GL_ARRAY_BUFFER, smoothNormalBufferId);
-            glEnableVertexAttribArray(1);
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
-
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferId);
-
-            glDrawElements(GL_TRIANGLES, mesh->verIndices.size(), GL_UNSIGNED_INT, 0);
-            release();
-        } else if (method == FLAT_SHADING) {
-            bind();
-            glBindBuffer(GL_ARRAY_BUFFER, flatVertexBufferId);
-            glEnableVertexAttribArray(0);
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
-
-            glBindBuffer(GL_ARRAY_BUFFER, flatNormalBufferId);
-            glEnableVertexAttribArray(1);
-            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
-
-            glDrawArrays(GL_TRIANGLES, 0, mesh->faceN * 3);
-            release();
+    // shader is the bound program.
+    void draw(ShadingMethod method, Shader &shader) {
+        if (method != SMOOTH_SHADING && method != FLAT_SHADING) {
+            return;
+        }
+        const GLint flatShadingLocation = shader.uniform_location("u_flatShading");
+        if (flatShadingLocation >= 0) {
+            glUniform1i(flatShadingLocation, method == FLAT_SHADING ? 1 : 0);
         }
+        bind();
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferId);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, normalBufferId);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferId);
+
+        glDrawElements(GL_TRIANGLES, mesh->verIndices.size(), GL_UNSIGNED_INT, 0);
+        release();
     }
 
     void bind() {
@@ -44,10 +44,13 @@ public:
 
     bool isAnyImguiWindowHovered = false;
 
+    // Hidden windows only provide a GL context (headless rendering) and don't wait for vsync.
+    const bool visible;
+
     ProjectionMode projectionMode = PERSPECTIVE;
 
-    Window(const int width, const int height, const char* window_name)
-            : width(width), height(height), win_name(window_name) {
+    Window(const int width, const int height, const char* window_name, bool visible = true)
+            : width(width), height(height), win_name(window_name), visible(visible) {
         initialize();
     }
 
@@ -83,6 +86,7 @@ public:
 
         glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, 1);
         glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 
         window = glfwCreateWindow(width, height, win_name.c_str(), nullptr, nullptr);
         if (!window) {
@@ -91,7 +95,7 @@ public:
         }
 
         glfwMakeContextCurrent(window);
-        glfwSwapInterval(1);
+        glfwSwapInterval(visible ? 1 : 0);
         glfwSetWindowPos(window, WINDOWPOS, 100);
 
         // OpenGL 3.x/4.xの関数をロードする (glfwMakeContextCurrentの後でないといけない)
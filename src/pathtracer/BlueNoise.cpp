@@ -0,0 +1,107 @@
+#include "BlueNoise.h"
+#include "Random.h"
+
+namespace {
+
+// Gaussian energy of a binary pattern on a torus, updated incrementally as pixels toggle.
+class EnergyField {
+public:
+    int size;
+    vector<float> kernel; // indexed by the toroidal offset between two pixels
+    vector<float> energy;
+    vector<unsigned char> pattern;
+
+    EnergyField(int size, float sigma) : size(size), kernel(size_t(size) * size), energy(size_t(size) * size, 0.0f),
+                                         pattern(size_t(size) * size, 0) {
+        for (int dy = 0; dy < size; dy++) {
+            for (int dx = 0; dx < size; dx++) {
+                float x = float(min(dx, size - dx));
+                float y = float(min(dy, size - dy));
+                kernel[size_t(dy) * size + dx] = exp(-(x * x + y * y) / (2.0f * sigma * sigma));
+            }
+        }
+    }
+
+    void toggle(int p) {
+        pattern[p] ^= 1;
+        const float sign = pattern[p] ? 1.0f : -1.0f;
+        const int px = p % size, py = p / size;
+        for (int y = 0; y < size; y++) {
+            const int dy = (y - py) & (size - 1);
+            for (int x = 0; x < size; x++) {
+                energy[size_t(y) * size + x] += sign * kernel[size_t(dy) * size + ((x - px) & (size - 1))];
+            }
+        }
+    }
+
+    // The set pixel with the highest energy.
+    int tightestCluster() const {
+        int best = -1;
+        for (int p = 0; p < (int)energy.size(); p++) {
+            if (pattern[p] && (best < 0 || energy[p] > energy[best])) {
+                best = p;
+            }
+        }
+        return best;
+    }
+
+    // The unset pixel with the lowest energy.
+    int largestVoid() const {
+        int best = -1;
+        for (int p = 0; p < (int)energy.size(); p++) {
+            if (!pattern[p] && (best < 0 || energy[p] < energy[best])) {
+                best = p;
+            }
+        }
+        return best;
+    }
+};
+
+} // namespace
+
+BlueNoiseMask::BlueNoiseMask(int size, float sigma) : size(size) {
+    const int n = size * size;
+    vector<int> rank(n);
+
+    // Initial binary pattern: 10% of the pixels, then swapped until the tightest cluster
+    // is also the largest void.
+    EnergyField field(size, sigma);
+    Xorshift rng(1u);
+    int ones = 0;
+    while (ones < n / 10) {
+        int p = int(rng.next() % uint32_t(n));
+        if (!field.pattern[p]) {
+            field.toggle(p);
+            ones++;
+        }
+    }
+    while (true) {
+        int cluster = field.tightestCluster();
+        field.toggle(cluster);
+        int voidPixel = field.largestVoid();
+        field.toggle(voidPixel);
+        if (voidPixel == cluster) {
+            break;
+        }
+    }
+    const EnergyField prototype = field;
+
+    // Phase 1: remove the tightest clusters of the prototype, ranking from ones - 1 down to 0.
+    for (int r = ones - 1; r >= 0; r--) {
+        int cluster = field.tightestCluster();
+        field.toggle(cluster);
+        rank[cluster] = r;
+    }
+    // Phases 2 and 3: fill the largest voids, ranking from ones up to n - 1.
+    field = prototype;
+    for (int r = ones; r < n; r++) {
+        int voidPixel = field.largestVoid();
+        field.toggle(voidPixel);
+        rank[voidPixel] = r;
+    }
+
+    values.resize(n);
+    for (int p = 0; p < n; p++) {
+        values[p] = (float(rank[p]) + 0.5f) / float(n);
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#ifndef BLUE_NOISE_H
+#define BLUE_NOISE_H
+
+#include "core/common.h"
+
+// Tileable blue-noise dither mask built with the void-and-cluster method (Ulichney 1993).
+// Every value (rank + 0.5) / (size * size) appears exactly once, and pixels with similar
+// values are spread apart. The mask is deterministic, so the CPU and GPU backends use
+// identical masks.
+class BlueNoiseMask {
+public:
+    int size; // power of two
+    vector<float> values; // size x size, row major
+
+    explicit BlueNoiseMask(int size = 64, float sigma = 1.5f);
+
+    float at(int x, int y) const {
+        return values[size_t(y & (size - 1)) * size + (x & (size - 1))];
+    }
+};
+
+#endif //BLUE_NOISE_H
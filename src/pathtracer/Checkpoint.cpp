@@ -0,0 +1,95 @@
+#include "Checkpoint.h"
+
+static const char CHECKPOINT_MAGIC[8] = {'P', 'T', 'C', 'K', 'P', 'T', '2', '\0'};
+// Larger images are refused as damaged headers rather than allocated.
+static const int CHECKPOINT_MAX_SIZE = 1 << 16;
+
+template<typename T>
+static void writeVector(ofstream &file, const vector<T> &data) {
+    file.write(reinterpret_cast<const char *>(data.data()), streamsize(sizeof(T) * data.size()));
+}
+
+template<typename T>
+static void readVector(ifstream &file, vector<T> &data, size_t n) {
+    data.resize(n);
+    file.read(reinterpret_cast<char *>(data.data()), streamsize(sizeof(T) * n));
+}
+
+void Checkpoint::save(const string &path) const {
+    const string tmpPath = path + ".tmp";
+    {
+        ofstream file(tmpPath, ios::binary | ios::trunc);
+        if (file.fail()) {
+            fprintf(stderr, "Can't write checkpoint \"%s\".\n", tmpPath.c_str());
+            exit(1);
+        }
+        const int32_t header[6] = {width, height, samples, nextConvergenceCheck, samplerType, samplesPerPass};
+        const int32_t tiles[2] = {tilesX, tilesY};
+        file.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        file.write(reinterpret_cast<const char *>(header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(&seed), sizeof(seed));
+        file.write(reinterpret_cast<const char *>(tiles), sizeof(tiles));
+        writeVector(file, accumulation);
+        writeVector(file, moments);
+        writeVector(file, albedo);
+        writeVector(file, normals);
+        writeVector(file, converged);
+        file.flush();
+        if (file.fail()) {
+            fprintf(stderr, "Can't write checkpoint \"%s\".\n", tmpPath.c_str());
+            exit(1);
+        }
+    }
+    error_code error;
+    filesystem::rename(tmpPath, path, error);
+    if (error) {
+        fprintf(stderr, "Can't rename checkpoint \"%s\": %s\n", tmpPath.c_str(), error.message().c_str());
+        exit(1);
+    }
+}
+
+bool Checkpoint::load(const string &path) {
+    ifstream file(path, ios::binary);
+    if (file.fail()) {
+        return false;
+    }
+    char magic[8];
+    int32_t header[6];
+    int32_t tiles[2];
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(header), sizeof(header));
+    file.read(reinterpret_cast<char *>(&seed), sizeof(seed));
+    file.read(reinterpret_cast<char *>(tiles), sizeof(tiles));
+    if (file.fail() || memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "\"%s\" is not a checkpoint.\n", path.c_str());
+        exit(1);
+    }
+    width = header[0];
+    height = header[1];
+    samples = header[2];
+    nextConvergenceCheck = header[3];
+    samplerType = header[4];
+    samplesPerPass = header[5];
+    tilesX = tiles[0];
+    tilesY = tiles[1];
+    const size_t pixels = size_t(width) * height;
+    const size_t headerBytes = sizeof(magic) + sizeof(header) + sizeof(seed) + sizeof(tiles);
+    error_code error;
+    const uintmax_t fileBytes = filesystem::file_size(path, error);
+    if (width <= 0 || height <= 0 || width > CHECKPOINT_MAX_SIZE || height > CHECKPOINT_MAX_SIZE ||
+        tilesX <= 0 || tilesY <= 0 || tilesX > width || tilesY > height || samples < 0 || samplesPerPass <= 0 ||
+        error || fileBytes != headerBytes + 4 * sizeof(glm::vec4) * pixels + size_t(tilesX) * tilesY) {
+        fprintf(stderr, "Checkpoint \"%s\" is damaged.\n", path.c_str());
+        exit(1);
+    }
+    readVector(file, accumulation, pixels);
+    readVector(file, moments, pixels);
+    readVector(file, albedo, pixels);
+    readVector(file, normals, pixels);
+    readVector(file, converged, size_t(tilesX) * tilesY);
+    if (file.fail()) {
+        fprintf(stderr, "Checkpoint \"%s\" is truncated.\n", path.c_str());
+        exit(1);
+    }
+    return true;
+}
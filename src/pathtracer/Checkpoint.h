@@ -0,0 +1,51 @@
+#pragma once
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "core/common.h"
+
+// Snapshot of a running accumulation, enough to continue it later. Sampling is stateless
+// (every sample is seeded from its pixel and sample index), so the index of the next sample
+// is the whole RNG state. A resumed render is bit-identical to an uninterrupted one as long
+// as both split the samples into the same passes, so the fixed number of samples per pass
+// (GPU) or per chunk (CPU) is stored and a resume with another one is refused.
+//
+// File layout, little endian:
+//   char     magic[8]             "PTCKPT2\0"
+//   int32    width, height
+//   int32    samples              samples per pixel accumulated = index of the next sample
+//   int32    nextConvergenceCheck sample count of the next adaptive sampling update
+//   int32    samplerType          see SamplerType
+//   int32    samplesPerPass       samples per GPU pass or CPU chunk
+//   uint32   seed
+//   int32    tilesX, tilesY       size of the convergence map
+//   float32  accumulation[width * height][4]
+//   float32  moments[width * height][4]
+//   float32  albedo[width * height][4]
+//   float32  normals[width * height][4]
+//   uint8    converged[tilesX * tilesY]
+struct Checkpoint {
+    int width = 0, height = 0;
+    int samples = 0;
+    int nextConvergenceCheck = 0;
+    int samplerType = 0;
+    int samplesPerPass = 0;
+    uint32_t seed = 0;
+    int tilesX = 0, tilesY = 0;
+    vector<glm::vec4> accumulation;
+    vector<glm::vec4> moments;
+    vector<glm::vec4> albedo;
+    vector<glm::vec4> normals;
+    vector<unsigned char> converged;
+
+    // Writes to path + ".tmp" and renames it over path, so a crash while saving keeps the
+    // previous checkpoint intact.
+    void save(const string &path) const;
+
+    // Returns false if there is no checkpoint at path; exits on a damaged file (checked against
+    // its header before anything is allocated).
+    bool load(const string &path);
+};
+
+#endif //CHECKPOINT_H
@@ -0,0 +1,95 @@
+#pragma once
+
+#ifndef CONVERGENCE_MAP_H
+#define CONVERGENCE_MAP_H
+
+#include "core/common.h"
+
+inline float luminance(const glm::vec3 &c) {
+    return glm::dot(c, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// Per-tile convergence state for adaptive sampling. It is computed from the luminance
+// moments of every pixel, stored as (sum L, sum L^2, sample count, unused). A tile stops
+// receiving samples once the relative standard error of its worst pixel drops below
+// threshold. Converged tiles stay converged.
+class ConvergenceMap {
+public:
+    int width, height;
+    int tileSize;
+    int tilesX, tilesY;
+    float threshold;
+    int minSamples = 16;
+
+    // 0 = keep sampling, 255 = converged; laid out to be uploaded as an R8 texture.
+    vector<unsigned char> converged;
+    int numConverged = 0;
+
+    ConvergenceMap(int width, int height, int tileSize, float threshold)
+            : width(width), height(height), tileSize(tileSize), threshold(threshold) {
+        tilesX = (width + tileSize - 1) / tileSize;
+        tilesY = (height + tileSize - 1) / tileSize;
+        converged.resize(size_t(tilesX) * tilesY, 0);
+    }
+
+    bool enabled() const {
+        return threshold > 0.0f;
+    }
+
+    bool allConverged() const {
+        return numConverged == tilesX * tilesY;
+    }
+
+    bool isConverged(int tile) const {
+        return converged[tile] != 0;
+    }
+
+    // Restores a saved state, e.g. from a Checkpoint.
+    void setConverged(const vector<unsigned char> &state) {
+        converged = state;
+        numConverged = int(count_if(converged.begin(), converged.end(), [](unsigned char c) { return c != 0; }));
+    }
+
+    static float relativeError(const glm::vec4 &moment) {
+        float n = moment.z;
+        if (n < 2.0f) {
+            return FLT_MAX;
+        }
+        float mean = moment.x / n;
+        float variance = max(moment.y / n - mean * mean, 0.0f) * n / (n - 1.0f);
+        return sqrt(variance / n) / (mean + 1e-3f);
+    }
+
+    // Returns the number of tiles that converged in this update.
+    int update(const vector<glm::vec4> &moments) {
+        if (!enabled()) {
+            return 0;
+        }
+        int newlyConverged = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+ : newlyConverged)
+        for (int tile = 0; tile < tilesX * tilesY; tile++) {
+            if (converged[tile]) {
+                continue;
+            }
+            const int x0 = (tile % tilesX) * tileSize;
+            const int y0 = (tile / tilesX) * tileSize;
+            float maxError = 0.0f;
+            bool enoughSamples = true;
+            for (int y = y0; y < min(y0 + tileSize, height); y++) {
+                for (int x = x0; x < min(x0 + tileSize, width); x++) {
+                    const glm::vec4 &m = moments[size_t(y) * width + x];
+                    enoughSamples = enoughSamples && m.z >= float(minSamples);
+                    maxError = max(maxError, relativeError(m));
+                }
+            }
+            if (enoughSamples && maxError < threshold) {
+                converged[tile] = 255;
+                newlyConverged++;
+            }
+        }
+        numConverged += newlyConverged;
+        return newlyConverged;
+    }
+};
+
+#endif //CONVERGENCE_MAP_H
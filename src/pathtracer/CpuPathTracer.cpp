@@ -0,0 +1,177 @@
+#include "CpuPathTracer.h"
+#include "core/Profiler.h"
+#include "core/Timer.h"
+
+RenderStats CpuPathTracer::render(int numSamples) {
+    PROFILE_SCOPE("CpuPathTracer::render");
+    Timer timer;
+    timer.start();
+
+    const int tilesX = (width + tileSize - 1) / tileSize;
+    const int tilesY = (height + tileSize - 1) / tileSize;
+    const int sampleBegin = numSamplesAccumulated;
+    if (samplerType == BLUE_NOISE_SAMPLER && !blueNoise) {
+        blueNoise = make_unique<BlueNoiseMask>();
+    }
+    uint64_t rays = 0;
+    uint64_t samples = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+ : rays, samples)
+    for (int tile = 0; tile < tilesX * tilesY; tile++) {
+        if (convergence.isConverged(tile)) {
+            continue;
+        }
+        uint64_t tileRays = 0;
+        renderTile(tile, sampleBegin, numSamples, tileRays);
+        rays += tileRays;
+        samples += uint64_t(min(tileSize, width - (tile % tilesX) * tileSize)) *
+                   min(tileSize, height - (tile / tilesX) * tileSize) * numSamples;
+    }
+    numSamplesAccumulated += numSamples;
+
+    RenderStats stats;
+    stats.seconds = timer.stop();
+    stats.rays = rays;
+    stats.samples = samples;
+    return stats;
+}
+
+void CpuPathTracer::renderTile(int tile, int sampleBegin, int numSamples, uint64_t &rays) {
+    PROFILE_SCOPE("CpuPathTracer::renderTile");
+    const int tilesX = (width + tileSize - 1) / tileSize;
+    const int x0 = (tile % tilesX) * tileSize;
+    const int y0 = (tile / tilesX) * tileSize;
+    const int x1 = min(x0 + tileSize, width);
+    const int y1 = min(y0 + tileSize, height);
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            const uint32_t pixel = uint32_t(y * width + x);
+            Ray ray = scene.camera.generateRay(glm::vec2(x + 0.5f, y + 0.5f), width, height);
+            glm::vec3 sum(0.0f);
+            glm::vec2 moment(0.0f);
+            for (int s = sampleBegin; s < sampleBegin + numSamples; s++) {
+                PathSampler sampler(samplerType, x, y, pixel, uint32_t(s), blueNoise.get(), seed);
+                glm::vec3 L = radiance(ray, sampler, rays);
+                float lum = luminance(L);
+                sum += L;
+                moment += glm::vec2(lum, lum * lum);
+            }
+            accumulation[pixel] += glm::vec4(sum, float(numSamples));
+            moments[pixel] += glm::vec4(moment, float(numSamples), 0.0f);
+
+            // Camera rays are not jittered, so the first hit is the same for every sample.
+            Hitpoint hp;
+            if (scene.intersect(ray, hp)) {
+                glm::vec3 normal = glm::dot(hp.normal, ray.dir) < 0.0f ? hp.normal : -hp.normal;
+                albedo[pixel] += glm::vec4(scene.material(hp.objectId).color * float(numSamples), float(numSamples));
+                normals[pixel] += glm::vec4(normal * float(numSamples), float(numSamples));
+            }
+        }
+    }
+}
+
+vector<glm::vec3> CpuPathTracer::image() const {
+    vector<glm::vec3> pixels(accumulation.size());
+#pragma omp parallel for
+    for (int i = 0; i < (int)pixels.size(); i++) {
+        pixels[i] = glm::vec3(accumulation[i]) / max(accumulation[i].w, 1.0f);
+    }
+    return pixels;
+}
+
+DenoiserInput CpuPathTracer::denoiserInput() const {
+    DenoiserInput input{width, height, image(), moments, vector<glm::vec3>(albedo.size()), vector<glm::vec3>(normals.size())};
+#pragma omp parallel for
+    for (int i = 0; i < (int)albedo.size(); i++) {
+        input.albedo[i] = glm::vec3(albedo[i]) / max(albedo[i].w, 1.0f);
+        input.normal[i] = glm::vec3(normals[i]) / max(normals[i].w, 1.0f);
+    }
+    return input;
+}
+
+Checkpoint CpuPathTracer::checkpoint() const {
+    Checkpoint checkpoint;
+    checkpoint.width = width;
+    checkpoint.height = height;
+    checkpoint.samples = numSamplesAccumulated;
+    checkpoint.samplerType = int(samplerType);
+    checkpoint.seed = seed;
+    checkpoint.tilesX = convergence.tilesX;
+    checkpoint.tilesY = convergence.tilesY;
+    checkpoint.accumulation = accumulation;
+    checkpoint.moments = moments;
+    checkpoint.albedo = albedo;
+    checkpoint.normals = normals;
+    checkpoint.converged = convergence.converged;
+    return checkpoint;
+}
+
+PartialAccumulation CpuPathTracer::partial(int sampleBegin) const {
+    return PartialAccumulation{width, height, sampleBegin, numSamplesAccumulated, int(samplerType), seed,
+                               accumulation, moments};
+}
+
+void CpuPathTracer::restore(const Checkpoint &checkpoint) {
+    if (checkpoint.width != width || checkpoint.height != height || checkpoint.samplerType != int(samplerType) ||
+        checkpoint.seed != seed || checkpoint.tilesX != convergence.tilesX || checkpoint.tilesY != convergence.tilesY) {
+        fprintf(stderr, "The checkpoint was made with a different resolution, sampler, seed or tile size.\n");
+        exit(1);
+    }
+    numSamplesAccumulated = checkpoint.samples;
+    accumulation = checkpoint.accumulation;
+    moments = checkpoint.moments;
+    albedo = checkpoint.albedo;
+    normals = checkpoint.normals;
+    convergence.setConverged(checkpoint.converged);
+}
+
+glm::vec3 CpuPathTracer::radiance(Ray ray, PathSampler &sampler, uint64_t &rays) const {
+    glm::vec3 accumulatedColor(0.0f);
+    glm::vec3 accumulatedReflectance(1.0f);
+    for (int depth = 0;; depth++) {
+        Hitpoint hp;
+        rays++;
+        if (!scene.intersect(ray, hp)) {
+            return accumulatedColor;
+        }
+        const Material obj = scene.material(hp.objectId);
+        glm::vec3 orientingNormal = glm::dot(hp.normal, ray.dir) < 0.0f ? hp.normal : -hp.normal;
+        glm::vec3 Xi = sampler.next();
+        accumulatedColor += accumulatedReflectance * obj.emission;
+
+        float rrp = max(obj.color.x, max(obj.color.y, obj.color.z)); // russian roulette probability
+        if (depth > PT_DEPTH_MAX) {
+            rrp *= pow(0.5f, float(depth - PT_DEPTH_MAX));
+        }
+        if (depth > PT_DEPTH_MIN) {
+            if (Xi.z >= rrp) {
+                return accumulatedColor;
+            }
+        } else {
+            rrp = 1.0f;
+        }
+        // Nothing can be added any more (e.g. after hitting the light), so stop early.
+        if (accumulatedReflectance == glm::vec3(0.0f)) {
+            return accumulatedColor;
+        }
+
+        switch (obj.reflectType) {
+            case DIFFUSE: {
+                glm::vec3 w = orientingNormal;
+                glm::vec3 u = glm::normalize(glm::cross(fabs(w.x) > 0.1f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), w));
+                glm::vec3 v = glm::normalize(glm::cross(w, u));
+                float r1 = 2.0f * float(M_PI) * Xi.x;
+                float r2 = Xi.y;
+                float r2s = sqrt(r2);
+                glm::vec3 dir = glm::normalize(u * cos(r1) * r2s + v * sin(r1) * r2s + w * sqrt(1.0f - r2));
+                ray = Ray{hp.pos + dir * float(PT_EPS * 10.0), dir};
+                accumulatedReflectance *= obj.color / rrp;
+            } break;
+
+            default: {
+                glm::vec3 dir = ray.dir - hp.normal * 2.0f * glm::dot(hp.normal, ray.dir);
+                ray = Ray{hp.pos + dir * float(PT_EPS * 10.0), dir};
+                accumulatedReflectance *= obj.color / rrp;
+            } break;
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#ifndef CPU_PATH_TRACER
+#define CPU_PATH_TRACER
+
+#include "Checkpoint.h"
+#include "ConvergenceMap.h"
+#include "Denoiser.h"
+#include "PartialAccumulation.h"
+#include "Sampler.h"
+#include "Scene.h"
+#include "core/common.h"
+
+struct RenderStats {
+    double seconds = 0.0;
+    uint64_t rays = 0;
+    uint64_t samples = 0;
+
+    double raysPerSec() const {
+        return seconds > 0.0 ? double(rays) / seconds : 0.0;
+    }
+};
+
+// CPU reference implementation of radiance() in render.frag. The image is split into
+// square tiles which are handed out to the worker threads dynamically.
+class CpuPathTracer {
+public:
+    Scene scene;
+    int width, height;
+    int tileSize = 16;
+    SamplerType samplerType = SOBOL_SAMPLER;
+    uint32_t seed = 0;
+    // Built by render() the first time the blue-noise sampler is used.
+    unique_ptr<BlueNoiseMask> blueNoise;
+
+    // Same layout as the GPU accumulation targets, in gl_FragCoord order (bottom row first):
+    // accumulation = (sum of radiance, sample count), moments = (sum L, sum L^2, sample count, 0).
+    vector<glm::vec4> accumulation;
+    vector<glm::vec4> moments;
+    // First-hit albedo and normal AOVs for the denoiser, (sum, sample count).
+    vector<glm::vec4> albedo;
+    vector<glm::vec4> normals;
+    int numSamplesAccumulated = 0;
+
+    ConvergenceMap convergence;
+
+    CpuPathTracer(const Scene &scene, int width, int height, float convergenceThreshold = 0.0f)
+            : scene(scene), width(width), height(height),
+              convergence(width, height, tileSize, convergenceThreshold) {
+        accumulation.resize(size_t(width) * height, glm::vec4(0.0f));
+        moments.resize(size_t(width) * height, glm::vec4(0.0f));
+        albedo.resize(size_t(width) * height, glm::vec4(0.0f));
+        normals.resize(size_t(width) * height, glm::vec4(0.0f));
+    }
+
+    // Adds numSamples samples to every pixel of the tiles that have not converged yet.
+    RenderStats render(int numSamples);
+
+    // Re-evaluates which tiles have converged; returns true once all of them have.
+    bool updateConvergence() {
+        convergence.update(moments);
+        return convergence.allConverged();
+    }
+
+    // Averaged radiance, ready to be written out.
+    vector<glm::vec3> image() const;
+
+    DenoiserInput denoiserInput() const;
+
+    Checkpoint checkpoint() const;
+
+    // The samples accumulated so far as a partial for renderer_merge, starting at sampleBegin.
+    PartialAccumulation partial(int sampleBegin) const;
+
+    // Continues the accumulation saved in checkpoint; exits if it belongs to another render.
+    void restore(const Checkpoint &checkpoint);
+
+    glm::vec3 radiance(Ray ray, PathSampler &sampler, uint64_t &rays) const;
+
+private:
+    void renderTile(int tile, int sampleBegin, int numSamples, uint64_t &rays);
+};
+
+#endif //CPU_PATH_TRACER
@@ -0,0 +1,96 @@
+#include "Denoiser.h"
+#include "ConvergenceMap.h"
+#include "core/Profiler.h"
+#include "core/Timer.h"
+
+vector<glm::vec3> Denoiser::denoise(const DenoiserInput &input) const {
+    PROFILE_SCOPE("Denoiser::denoise");
+    Timer timer;
+    timer.start();
+
+    const int width = input.width, height = input.height;
+    const size_t n = size_t(width) * height;
+    vector<glm::vec3> color = input.color, nextColor(n);
+    vector<float> variance(n), nextVariance(n);
+    vector<glm::vec3> normal(n);
+#pragma omp parallel for
+    for (int i = 0; i < (int)n; i++) {
+        // Variance of the mean luminance, which is what is left in the averaged color.
+        const glm::vec4 &m = input.moments[i];
+        const float count = max(m.z, 1.0f);
+        const float mean = m.x / count;
+        variance[i] = max(m.y / count - mean * mean, 0.0f) / count;
+        const float length = glm::length(input.normal[i]);
+        normal[i] = length > 0.0f ? input.normal[i] / length : glm::vec3(0.0f);
+    }
+
+    const float kernel[3] = {3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+    vector<float> blurredVariance(n);
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        PROFILE_SCOPE("a-trous iteration");
+        const int step = 1 << iteration;
+        // A 3x3 Gaussian of the variance, so that pixels whose few samples all agreed (e.g. all
+        // black) still get blended with their neighbours.
+#pragma omp parallel for
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                float sum = 0.0f, sumWeight = 0.0f;
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        const int qx = x + dx, qy = y + dy;
+                        if (qx >= 0 && qx < width && qy >= 0 && qy < height) {
+                            const float w = (dx == 0 ? 0.5f : 0.25f) * (dy == 0 ? 0.5f : 0.25f);
+                            sum += w * variance[size_t(qy) * width + qx];
+                            sumWeight += w;
+                        }
+                    }
+                }
+                blurredVariance[size_t(y) * width + x] = sum / sumWeight;
+            }
+        }
+
+#pragma omp parallel for schedule(dynamic, 4)
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                const size_t p = size_t(y) * width + x;
+                const float lumP = luminance(color[p]);
+                const float lumScale = sigmaLuminance * sqrt(blurredVariance[p]) + 1e-4f;
+                glm::vec3 sumColor(0.0f);
+                float sumVariance = 0.0f, sumWeight = 0.0f;
+                for (int dy = -2; dy <= 2; dy++) {
+                    const int qy = y + dy * step;
+                    if (qy < 0 || qy >= height) {
+                        continue;
+                    }
+                    for (int dx = -2; dx <= 2; dx++) {
+                        const int qx = x + dx * step;
+                        if (qx < 0 || qx >= width) {
+                            continue;
+                        }
+                        const size_t q = size_t(qy) * width + qx;
+                        const float wNormal = pow(max(glm::dot(normal[p], normal[q]), 0.0f), sigmaNormal);
+                        const glm::vec3 dAlbedo = input.albedo[p] - input.albedo[q];
+                        const float wAlbedo = exp(-glm::dot(dAlbedo, dAlbedo) / (sigmaAlbedo * sigmaAlbedo));
+                        const float wLuminance = exp(-fabs(lumP - luminance(color[q])) / lumScale);
+                        const float w = kernel[abs(dx)] * kernel[abs(dy)] * wNormal * wAlbedo * wLuminance;
+                        sumColor += w * color[q];
+                        sumVariance += w * w * variance[q];
+                        sumWeight += w;
+                    }
+                }
+                // The center pixel always has weight > 0 unless its normal is zero (background).
+                if (sumWeight > 0.0f) {
+                    nextColor[p] = sumColor / sumWeight;
+                    nextVariance[p] = sumVariance / (sumWeight * sumWeight);
+                } else {
+                    nextColor[p] = color[p];
+                    nextVariance[p] = variance[p];
+                }
+            }
+        }
+        color.swap(nextColor);
+        variance.swap(nextVariance);
+    }
+    printf("Denoising took %.3f sec (%d iterations)\n", timer.stop(), iterations);
+    return color;
+}
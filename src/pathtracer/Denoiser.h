@@ -0,0 +1,35 @@
+#pragma once
+
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include "core/common.h"
+
+// Per-pixel inputs of the denoiser, all width x height and bottom row first like the
+// accumulation buffers.
+struct DenoiserInput {
+    int width, height;
+    vector<glm::vec3> color;   // averaged radiance
+    vector<glm::vec4> moments; // (sum L, sum L^2, sample count, 0), see ConvergenceMap
+    vector<glm::vec3> albedo;  // averaged first-hit albedo
+    vector<glm::vec3> normal;  // averaged first-hit normal, facing the camera
+};
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) with the variance-guided
+// luminance weight of SVGF (Schied et al. 2017). Each iteration applies a 5x5 B3-spline
+// kernel with holes of 2^i pixels; the weights stop at changes of normal and albedo and at
+// luminance differences that are large compared to the per-pixel standard error. Rows are
+// filtered in parallel.
+class Denoiser {
+public:
+    int iterations = 5;
+    float sigmaLuminance = 4.0f;
+    float sigmaNormal = 128.0f; // exponent of the normal weight
+    float sigmaAlbedo = 0.1f;
+
+    Denoiser() = default;
+
+    vector<glm::vec3> denoise(const DenoiserInput &input) const;
+};
+
+#endif //DENOISER_H
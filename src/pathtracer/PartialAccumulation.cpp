@@ -0,0 +1,89 @@
+#include "PartialAccumulation.h"
+
+static const char PARTIAL_MAGIC[8] = {'P', 'T', 'P', 'A', 'R', 'T', '1', '\0'};
+
+void PartialAccumulation::save(const string &path) const {
+    const string tmpPath = path + ".tmp";
+    {
+        ofstream file(tmpPath, ios::binary | ios::trunc);
+        if (file.fail()) {
+            fprintf(stderr, "Can't write \"%s\".\n", tmpPath.c_str());
+            exit(1);
+        }
+        const int32_t header[5] = {width, height, sampleBegin, sampleEnd, samplerType};
+        file.write(PARTIAL_MAGIC, sizeof(PARTIAL_MAGIC));
+        file.write(reinterpret_cast<const char *>(header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(&seed), sizeof(seed));
+        file.write(reinterpret_cast<const char *>(accumulation.data()), streamsize(sizeof(glm::vec4) * accumulation.size()));
+        file.write(reinterpret_cast<const char *>(moments.data()), streamsize(sizeof(glm::vec4) * moments.size()));
+        file.flush();
+        if (file.fail()) {
+            fprintf(stderr, "Can't write \"%s\".\n", tmpPath.c_str());
+            exit(1);
+        }
+    }
+    error_code error;
+    filesystem::rename(tmpPath, path, error);
+    if (error) {
+        fprintf(stderr, "Can't rename \"%s\": %s\n", tmpPath.c_str(), error.message().c_str());
+        exit(1);
+    }
+}
+
+void PartialAccumulation::load(const string &path) {
+    ifstream file(path, ios::binary);
+    if (file.fail()) {
+        fprintf(stderr, "\"%s\" does not exist.\n", path.c_str());
+        exit(1);
+    }
+    char magic[8];
+    int32_t header[5];
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(header), sizeof(header));
+    file.read(reinterpret_cast<char *>(&seed), sizeof(seed));
+    if (file.fail() || memcmp(magic, PARTIAL_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "\"%s\" is not a partial accumulation.\n", path.c_str());
+        exit(1);
+    }
+    width = header[0];
+    height = header[1];
+    sampleBegin = header[2];
+    sampleEnd = header[3];
+    samplerType = header[4];
+    const size_t pixels = size_t(width) * height;
+    accumulation.resize(pixels);
+    moments.resize(pixels);
+    file.read(reinterpret_cast<char *>(accumulation.data()), streamsize(sizeof(glm::vec4) * pixels));
+    file.read(reinterpret_cast<char *>(moments.data()), streamsize(sizeof(glm::vec4) * pixels));
+    if (file.fail()) {
+        fprintf(stderr, "\"%s\" is truncated.\n", path.c_str());
+        exit(1);
+    }
+}
+
+void PartialAccumulation::add(const PartialAccumulation &other) {
+    if (other.width != width || other.height != height) {
+        fprintf(stderr, "Can't merge a %dx%d partial into a %dx%d one.\n", other.width, other.height, width, height);
+        exit(1);
+    }
+    if (other.samplerType != samplerType) {
+        fprintf(stderr, "Can't merge partials rendered with different samplers.\n");
+        exit(1);
+    }
+#pragma omp parallel for
+    for (int i = 0; i < (int)accumulation.size(); i++) {
+        accumulation[i] += other.accumulation[i];
+        moments[i] += other.moments[i];
+    }
+    sampleBegin = min(sampleBegin, other.sampleBegin);
+    sampleEnd = max(sampleEnd, other.sampleEnd);
+}
+
+vector<glm::vec3> PartialAccumulation::image() const {
+    vector<glm::vec3> pixels(accumulation.size());
+#pragma omp parallel for
+    for (int i = 0; i < (int)pixels.size(); i++) {
+        pixels[i] = glm::vec3(accumulation[i]) / max(accumulation[i].w, 1.0f);
+    }
+    return pixels;
+}
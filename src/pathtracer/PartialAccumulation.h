@@ -0,0 +1,44 @@
+#pragma once
+
+#ifndef PARTIAL_ACCUMULATION_H
+#define PARTIAL_ACCUMULATION_H
+
+#include "core/common.h"
+
+// Accumulation of the samples [sampleBegin, sampleEnd) of every pixel, rendered by one job.
+// Samples are seeded from (pixel, sample index, seed), so jobs with disjoint ranges and the
+// same seed add up to exactly the samples of a single render; renderer_merge sums them.
+//
+// File layout (".part"), little endian:
+//   char     magic[8]      "PTPART1\0"
+//   int32    width, height
+//   int32    sampleBegin, sampleEnd
+//   int32    samplerType   see SamplerType
+//   uint32   seed
+//   float32  accumulation[width * height][4]  (sum of radiance, sample count)
+//   float32  moments[width * height][4]       (sum L, sum L^2, sample count, 0)
+// Pixels are stored bottom row first. Tiles stopped by adaptive sampling have fewer samples,
+// which is why every pixel carries its own count.
+struct PartialAccumulation {
+    int width = 0, height = 0;
+    int sampleBegin = 0, sampleEnd = 0;
+    int samplerType = 0;
+    uint32_t seed = 0;
+    vector<glm::vec4> accumulation;
+    vector<glm::vec4> moments;
+
+    // Written to path + ".tmp" first and renamed, like Checkpoint.
+    void save(const string &path) const;
+
+    // Exits if path can't be read.
+    void load(const string &path);
+
+    // Adds the samples of other and widens the sample range to cover both; exits if other
+    // belongs to a different image or sampler. Overlapping ranges are not detected here.
+    void add(const PartialAccumulation &other);
+
+    // Averaged radiance.
+    vector<glm::vec3> image() const;
+};
+
+#endif //PARTIAL_ACCUMULATION_H
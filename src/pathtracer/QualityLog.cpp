@@ -0,0 +1,46 @@
+#include "QualityLog.h"
+#include "core/Image.h"
+
+ImageError compareImages(const vector<glm::vec3> &image, const vector<glm::vec3> &reference) {
+    double squared = 0.0, relative = 0.0;
+#pragma omp parallel for reduction(+ : squared, relative)
+    for (int i = 0; i < (int)image.size(); i++) {
+        for (int c = 0; c < 3; c++) {
+            const double d = double(image[i][c]) - reference[i][c];
+            squared += d * d;
+            relative += d * d / (double(reference[i][c]) * reference[i][c] + 0.01);
+        }
+    }
+    const double n = 3.0 * image.size();
+    return ImageError{sqrt(squared / n), relative / n};
+}
+
+QualityLog::QualityLog(const string &referencePath, const string &csvPath, int width, int height) {
+    int referenceWidth = 0, referenceHeight = 0;
+    if (!readImage(referencePath, reference, referenceWidth, referenceHeight)) {
+        exit(1);
+    }
+    if (referenceWidth != width || referenceHeight != height) {
+        fprintf(stderr, "The reference is %dx%d but the render is %dx%d.\n", referenceWidth, referenceHeight,
+                width, height);
+        exit(1);
+    }
+    file.open(csvPath);
+    if (file.fail()) {
+        fprintf(stderr, "Can't write \"%s\".\n", csvPath.c_str());
+        exit(1);
+    }
+    file << "seconds,samples,rmse,relmse\n";
+}
+
+void QualityLog::record(double seconds, int samples, const vector<glm::vec3> &image) {
+    last = compareImages(image, reference);
+    lastSamples = samples;
+    char line[128];
+    snprintf(line, sizeof(line), "%.6f,%d,%.8g,%.8g\n", seconds, samples, last.rmse, last.relMse);
+    file << line << flush;
+    printf("%8.3f sec %6d spp: RMSE %.6f, relMSE %.6f\n", seconds, samples, last.rmse, last.relMse);
+    while (nextSamples <= samples) {
+        nextSamples *= 2;
+    }
+}
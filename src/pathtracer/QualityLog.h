@@ -0,0 +1,49 @@
+#pragma once
+
+#ifndef QUALITY_LOG_H
+#define QUALITY_LOG_H
+
+#include "core/common.h"
+
+struct ImageError {
+    double rmse = 0.0;
+    // Relative MSE, (x - r)^2 / (r^2 + 0.01) averaged over pixels and channels, so dark and
+    // bright regions weigh alike.
+    double relMse = 0.0;
+};
+
+ImageError compareImages(const vector<glm::vec3> &image, const vector<glm::vec3> &reference);
+
+// Time-to-quality log: the error of a progressive render against a converged reference
+// (e.g. a high-spp render saved as .hdr), written to CSV as
+//
+//   seconds,samples,rmse,relmse
+//
+// seconds is render time only, without the time spent measuring. Entries are due at 1, 2,
+// 4, 8, ... samples per pixel, which spaces them evenly on the usual log-log plot.
+class QualityLog {
+private:
+    vector<glm::vec3> reference;
+    ofstream file;
+    int nextSamples = 1;
+
+public:
+    ImageError last;
+    int lastSamples = 0;
+
+    // Exits if the reference can't be read or doesn't match width x height.
+    QualityLog(const string &referencePath, const string &csvPath, int width, int height);
+
+    // Samples per pixel at which the next entry is due.
+    int nextEntry() const {
+        return nextSamples;
+    }
+
+    bool due(int samples) const {
+        return samples >= nextSamples;
+    }
+
+    void record(double seconds, int samples, const vector<glm::vec3> &image);
+};
+
+#endif //QUALITY_LOG_H
@@ -0,0 +1,46 @@
+#pragma once
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+// xorshift128, seeded the same way as initSeeds()/rand() in render.frag.
+class Xorshift {
+private:
+    uint32_t seed_[4];
+
+public:
+    explicit Xorshift(uint32_t seed) {
+        seed_[0] = 1812433253U * (seed ^ (seed >> 30U)) + 1U;
+        seed_[1] = 1812433253U * (seed_[0] ^ (seed_[0] >> 30U)) + 2U;
+        seed_[2] = 1812433253U * (seed_[1] ^ (seed_[1] >> 30U)) + 3U;
+        seed_[3] = 1812433253U * (seed_[2] ^ (seed_[2] >> 30U)) + 4U;
+    }
+
+    uint32_t next() {
+        uint32_t t = seed_[0] ^ (seed_[0] << 11U);
+        seed_[0] = seed_[1];
+        seed_[1] = seed_[2];
+        seed_[2] = seed_[3];
+        seed_[3] = (seed_[3] ^ (seed_[3] >> 19U)) ^ (t ^ (t >> 8U));
+        return seed_[3];
+    }
+
+    // Uniform in [0, 1).
+    float next01() {
+        return float(next() >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+// Integer hash used to derive independent per-pixel, per-sample seeds.
+inline uint32_t hashUint(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+#endif //RANDOM_H
@@ -0,0 +1,124 @@
+#pragma once
+
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "BlueNoise.h"
+#include "Random.h"
+#include "core/common.h"
+
+// Sample generators of the path tracers. Each bounce draws one 3D point: two dimensions for
+// the direction and one for russian roulette. Mirrors initSampler()/nextSample() in
+// render.frag, so both backends see the same numbers.
+enum SamplerType {
+    RANDOM_SAMPLER = 0,     // xorshift seeded per pixel and sample
+    SOBOL_SAMPLER = 1,      // Owen-scrambled Sobol, scrambled per pixel and bounce
+    BLUE_NOISE_SAMPLER = 2, // one Owen-scrambled Sobol sequence for all pixels, rotated by a blue-noise mask
+};
+
+// Direction numbers of the first three Sobol dimensions (Joe & Kuo), MSB first.
+const uint32_t SOBOL_DIRECTIONS[3][32] = {
+        {0x80000000U, 0x40000000U, 0x20000000U, 0x10000000U, 0x08000000U, 0x04000000U, 0x02000000U, 0x01000000U,
+         0x00800000U, 0x00400000U, 0x00200000U, 0x00100000U, 0x00080000U, 0x00040000U, 0x00020000U, 0x00010000U,
+         0x00008000U, 0x00004000U, 0x00002000U, 0x00001000U, 0x00000800U, 0x00000400U, 0x00000200U, 0x00000100U,
+         0x00000080U, 0x00000040U, 0x00000020U, 0x00000010U, 0x00000008U, 0x00000004U, 0x00000002U, 0x00000001U},
+        {0x80000000U, 0xc0000000U, 0xa0000000U, 0xf0000000U, 0x88000000U, 0xcc000000U, 0xaa000000U, 0xff000000U,
+         0x80800000U, 0xc0c00000U, 0xa0a00000U, 0xf0f00000U, 0x88880000U, 0xcccc0000U, 0xaaaa0000U, 0xffff0000U,
+         0x80008000U, 0xc000c000U, 0xa000a000U, 0xf000f000U, 0x88008800U, 0xcc00cc00U, 0xaa00aa00U, 0xff00ff00U,
+         0x80808080U, 0xc0c0c0c0U, 0xa0a0a0a0U, 0xf0f0f0f0U, 0x88888888U, 0xccccccccU, 0xaaaaaaaaU, 0xffffffffU},
+        {0x80000000U, 0xc0000000U, 0x60000000U, 0x90000000U, 0xe8000000U, 0x5c000000U, 0x8e000000U, 0xc5000000U,
+         0x68800000U, 0x9cc00000U, 0xee600000U, 0x55900000U, 0x80680000U, 0xc09c0000U, 0x60ee0000U, 0x90550000U,
+         0xe8808000U, 0x5cc0c000U, 0x8e606000U, 0xc5909000U, 0x6868e800U, 0x9c9c5c00U, 0xeeee8e00U, 0x5555c500U,
+         0x8000e880U, 0xc0005cc0U, 0x60008e60U, 0x9000c590U, 0xe8006868U, 0x5c009c9cU, 0x8e00eeeeU, 0xc5005555U},
+};
+
+inline uint32_t sobol(uint32_t index, int dim) {
+    uint32_t x = 0;
+    for (int bit = 0; index != 0; bit++, index >>= 1) {
+        if (index & 1U) {
+            x ^= SOBOL_DIRECTIONS[dim][bit];
+        }
+    }
+    return x;
+}
+
+inline uint32_t reverseBits(uint32_t x) {
+    x = ((x >> 1) & 0x55555555U) | ((x & 0x55555555U) << 1);
+    x = ((x >> 2) & 0x33333333U) | ((x & 0x33333333U) << 2);
+    x = ((x >> 4) & 0x0f0f0f0fU) | ((x & 0x0f0f0f0fU) << 4);
+    x = ((x >> 8) & 0x00ff00ffU) | ((x & 0x00ff00ffU) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+inline uint32_t hashCombine(uint32_t seed, uint32_t v) {
+    return seed ^ (v + (seed << 6) + (seed >> 2));
+}
+
+// Hash-based Owen scrambling (Burley 2020, "Practical Hash-based Owen Scrambling").
+inline uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cU;
+    x ^= x * 0xb82f1e52U;
+    x ^= x * 0xc7afe638U;
+    x ^= x * 0x8d22f6e6U;
+    return reverseBits(x);
+}
+
+// Maps 32 random bits to [0, 1) with float precision.
+inline float toUnitFloat(uint32_t x) {
+    return float(x >> 8) * (1.0f / 16777216.0f);
+}
+
+// Point index of the shuffled, Owen-scrambled 3D Sobol sequence identified by seed.
+inline glm::vec3 sobolOwen(uint32_t index, uint32_t seed) {
+    const uint32_t shuffledIndex = nestedUniformScramble(index, hashCombine(seed, 0U));
+    glm::vec3 u;
+    for (int dim = 0; dim < 3; dim++) {
+        u[dim] = toUnitFloat(nestedUniformScramble(sobol(shuffledIndex, dim), hashCombine(seed, uint32_t(dim + 1))));
+    }
+    return u;
+}
+
+// Sample stream of one path.
+class PathSampler {
+private:
+    SamplerType type;
+    int x, y;
+    uint32_t seedOffset;
+    uint32_t pixelSeed;
+    uint32_t sampleIndex;
+    int bounce = 0;
+    Xorshift rng;
+    const BlueNoiseMask *blueNoise;
+
+public:
+    // seed selects an independent set of sequences; seed 0 gives the default ones.
+    PathSampler(SamplerType type, int x, int y, uint32_t pixel, uint32_t sampleIndex, const BlueNoiseMask *blueNoise,
+                uint32_t seed = 0)
+            : type(type), x(x), y(y), seedOffset(seed * 0x9e3779b9U), pixelSeed(hashUint(pixel) ^ seedOffset),
+              sampleIndex(sampleIndex), rng(hashUint(pixel + hashUint(sampleIndex)) ^ seedOffset), blueNoise(blueNoise) {
+    }
+
+    glm::vec3 next() {
+        const uint32_t b = uint32_t(bounce++);
+        switch (type) {
+            case SOBOL_SAMPLER:
+                return sobolOwen(sampleIndex, hashCombine(pixelSeed, b));
+            case BLUE_NOISE_SAMPLER: {
+                // Cranley-Patterson rotation by toroidally shifted copies of the mask, one per dimension.
+                glm::vec3 u = sobolOwen(sampleIndex, hashUint(b) ^ seedOffset);
+                for (int dim = 0; dim < 3; dim++) {
+                    uint32_t shift = hashUint(3U * b + uint32_t(dim));
+                    float r = u[dim] + blueNoise->at(x + int(shift & 0xffffU), y + int(shift >> 16));
+                    u[dim] = r >= 1.0f ? r - 1.0f : r;
+                }
+                return u;
+            }
+            default:
+                return glm::vec3(rng.next01(), rng.next01(), rng.next01());
+        }
+    }
+};
+
+#endif //SAMPLER_H
@@ -0,0 +1,39 @@
+#pragma once
+
+#ifndef SAMPLES_PER_PASS_TUNER_H
+#define SAMPLES_PER_PASS_TUNER_H
+
+#include "core/common.h"
+
+// Picks how many samples per pixel one full-screen pass computes so that a pass takes
+// about targetMs. Each update moves by at most a factor of two to stay stable.
+class SamplesPerPassTuner {
+public:
+    double targetMs;
+    int samplesPerPass = 1;
+    int maxSamplesPerPass = 4096;
+    bool fixed = false;
+
+    // fixedSamplesPerPass > 0 disables tuning.
+    SamplesPerPassTuner(double targetMs, int fixedSamplesPerPass = 0)
+            : targetMs(targetMs) {
+        if (fixedSamplesPerPass > 0) {
+            samplesPerPass = fixedSamplesPerPass;
+            fixed = true;
+        }
+    }
+
+    // elapsedMs is the GPU time of a pass that computed passSamples samples per pixel.
+    void update(double elapsedMs, int passSamples) {
+        if (fixed || elapsedMs <= 0.0 || passSamples <= 0) {
+            return;
+        }
+        double msPerSample = elapsedMs / passSamples;
+        int ideal = int(targetMs / msPerSample);
+        int lower = max(passSamples / 2, 1);
+        int upper = min(passSamples * 2, maxSamplesPerPass);
+        samplesPerPass = max(lower, min(ideal, upper));
+    }
+};
+
+#endif //SAMPLES_PER_PASS_TUNER_H
@@ -0,0 +1,241 @@
+#pragma once
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "core/common.h"
+#include "mesh/BVH.h"
+
+// Mirrors the definitions in shaders/render.frag so that the CPU and GPU backends
+// trace exactly the same scene.
+#define PT_EPS 1e-6
+#define PT_INF 1e10
+#define PT_DEPTH_MAX 100
+#define PT_DEPTH_MIN 30
+// Minimum hit distance on meshes; triangles are intersected in float, so PT_EPS is too small.
+#define PT_MESH_EPS 1e-3
+
+enum ReflectionType {
+    DIFFUSE = 0,
+    SPECULAR = 1,
+    REFRACTION = 2,
+};
+
+struct Material {
+    glm::vec3 color;
+    glm::vec3 emission;
+    ReflectionType reflectType;
+};
+
+struct Ray {
+    glm::vec3 org;
+    glm::vec3 dir;
+};
+
+struct Hitpoint {
+    glm::vec3 pos;
+    glm::vec3 normal;
+    float dist = float(PT_INF);
+    int objectId = -1;
+};
+
+struct Sphere {
+    float radius;
+    glm::vec3 center;
+    glm::vec3 color;
+    glm::vec3 emission;
+    ReflectionType reflectType;
+
+    // Same root selection as intersectSphere2() in render.frag. Evaluated in double
+    // because the walls are spheres of radius 1e6.
+    bool intersect(const Ray &r, Hitpoint &hp) const {
+        glm::dvec3 oc = glm::dvec3(r.org) - glm::dvec3(center);
+        glm::dvec3 dir = glm::dvec3(r.dir);
+        double b = glm::dot(dir, oc);
+        double c = glm::dot(oc, oc) - double(radius) * double(radius);
+        double D = b * b - c;
+        if (D < 0.0) {
+            return false;
+        }
+        double sD = sqrt(D);
+        double t1, t2;
+        if (b > 0.0) {
+            t1 = -b - sD;
+            t2 = c / t1;
+        } else {
+            t2 = -b + sD;
+            t1 = c / t2;
+        }
+        if (t1 < PT_EPS && t2 < PT_EPS) return false;
+        hp.dist = float(t1 > PT_EPS ? t1 : t2);
+        hp.pos = r.org + hp.dist * r.dir;
+        hp.normal = glm::normalize(hp.pos - center);
+        return true;
+    }
+};
+
+// Triangle mesh in world space with a single material. Its objectId is the number of spheres.
+struct MeshObject {
+    TriMesh mesh;
+    BVH bvh;
+    Material material;
+
+    // Scales the mesh uniformly so that the longest side of its bounding box is size, moves the
+    // center of the bottom of the bounding box to base and builds the BVH. A BVH built over
+    // triMesh (e.g. read from its mesh cache) is transformed along instead of being rebuilt.
+    MeshObject(const TriMesh &triMesh, const glm::vec3 &base, float size, const Material &material,
+               const BVH *triMeshBvh = nullptr)
+            : mesh(triMesh), material(material) {
+        glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+        for (const glm::vec3 &v : mesh.vertices) {
+            boundsMin = glm::min(boundsMin, v);
+            boundsMax = glm::max(boundsMax, v);
+        }
+        glm::vec3 extent = boundsMax - boundsMin;
+        float scale = size / max(max(extent.x, extent.y), max(extent.z, FLT_MIN));
+        glm::vec3 bottom((boundsMin.x + boundsMax.x) * 0.5f, boundsMin.y, (boundsMin.z + boundsMax.z) * 0.5f);
+#pragma omp parallel for
+        for (int i = 0; i < (int)mesh.vertices.size(); i++) {
+            mesh.vertices[i] = (mesh.vertices[i] - bottom) * scale + base;
+        }
+        // Only the vertices and faces are used for tracing.
+        mesh.markModified();
+        mesh.releaseDerived();
+        if (!triMeshBvh || triMeshBvh->nodes.empty()) {
+            bvh.build(mesh);
+            return;
+        }
+        // The same rounding as for the vertices keeps them inside the transformed bounds.
+        bvh = *triMeshBvh;
+#pragma omp parallel for
+        for (int i = 0; i < (int)bvh.nodes.size(); i++) {
+            bvh.nodes[i].boundsMin = (bvh.nodes[i].boundsMin - bottom) * scale + base;
+            bvh.nodes[i].boundsMax = (bvh.nodes[i].boundsMax - bottom) * scale + base;
+        }
+    }
+
+    bool intersect(const Ray &r, Hitpoint &hp) const {
+        float t = hp.dist;
+        unsigned int face;
+        if (!bvh.intersect(mesh, r.org, r.dir, t, face, float(PT_MESH_EPS))) {
+            return false;
+        }
+        const glm::vec3 &v0 = mesh.vertices[mesh.verIndices[3 * face + 0]];
+        const glm::vec3 &v1 = mesh.vertices[mesh.verIndices[3 * face + 1]];
+        const glm::vec3 &v2 = mesh.vertices[mesh.verIndices[3 * face + 2]];
+        hp.dist = t;
+        hp.pos = r.org + t * r.dir;
+        hp.normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
+        return true;
+    }
+
+    // Two RGBA32UI texels per BVH node, as read by intersectMesh() in render.frag:
+    // (boundsMin, leftFirst), (boundsMax, triCount), i.e. the BVHNode as it is. The bounds keep
+    // their bits (the shader reads them with uintBitsToFloat), and the indices are exact at any
+    // size, which they would not be as floats above 2^24.
+    vector<glm::uvec4> packNodes() const {
+        static_assert(sizeof(BVHNode) == 2 * sizeof(glm::uvec4), "BVHNode must be two texels");
+        vector<glm::uvec4> texels(bvh.nodes.size() * 2);
+        memcpy(static_cast<void *>(texels.data()), bvh.nodes.data(), sizeof(BVHNode) * bvh.nodes.size());
+        return texels;
+    }
+
+    // Three RGBA32F texels per face (its vertices), in BVH leaf order so that leaves index
+    // the triangles directly.
+    vector<glm::vec4> packTriangles() const {
+        vector<glm::vec4> texels(bvh.triIndices.size() * 3);
+#pragma omp parallel for
+        for (int i = 0; i < (int)bvh.triIndices.size(); i++) {
+            const unsigned int face = bvh.triIndices[i];
+            for (int j = 0; j < 3; j++) {
+                texels[3 * i + j] = glm::vec4(mesh.vertices[mesh.verIndices[3 * face + j]], 0.0f);
+            }
+        }
+        return texels;
+    }
+};
+
+struct Camera {
+    glm::vec3 position = {50.0f, 52.0f, 220.0f};
+    glm::vec3 dir = glm::normalize(glm::vec3(0.0f, -0.04f, -1.0f));
+    glm::vec3 up = {0.0f, 1.0f, 0.0f};
+    float screenDist = 40.0f;
+    float screenHeight = 30.0f;
+
+    // fragCoord follows gl_FragCoord: pixel centers, origin at the bottom left.
+    Ray generateRay(glm::vec2 fragCoord, int width, int height) const {
+        float screenWidth = screenHeight * float(width) / float(height);
+        glm::vec3 screenX = glm::normalize(glm::cross(dir, up));
+        glm::vec3 screenY = glm::normalize(glm::cross(screenX, dir));
+        glm::vec3 screenCenter = position + dir * screenDist;
+        float pixSize = screenHeight / float(height);
+        glm::vec3 pixPos = screenX * (fragCoord.x / float(width) - 0.5f) * screenWidth
+                           + screenY * (fragCoord.y / float(height) - 0.5f) * screenHeight + screenCenter;
+        glm::vec3 pos = pixPos + pixSize / 2.0f * (screenX + screenY);
+        return Ray{position, glm::normalize(pos - position)};
+    }
+};
+
+class Scene {
+public:
+    vector<Sphere> spheres;
+    shared_ptr<const MeshObject> mesh;
+    Camera camera;
+
+    bool intersect(const Ray &r, Hitpoint &hp) const {
+        hp.dist = float(PT_INF);
+        hp.objectId = -1;
+        for (int i = 0; i < (int)spheres.size(); i++) {
+            Hitpoint tmp;
+            if (spheres[i].intersect(r, tmp) && tmp.dist < hp.dist) {
+                hp = tmp;
+                hp.objectId = i;
+            }
+        }
+        if (mesh && mesh->intersect(r, hp)) {
+            hp.objectId = (int)spheres.size();
+        }
+        return hp.objectId != -1;
+    }
+
+    Material material(int objectId) const {
+        if (objectId == (int)spheres.size()) {
+            return mesh->material;
+        }
+        const Sphere &s = spheres[objectId];
+        return Material{s.color, s.emission, s.reflectType};
+    }
+
+    // Three RGBA32F texels per sphere, as read by fetchSphere() in render.frag:
+    // (center, radius), (color, reflectType), (emission, 0).
+    vector<glm::vec4> packSpheres() const {
+        vector<glm::vec4> texels;
+        texels.reserve(spheres.size() * 3);
+        for (const Sphere &s : spheres) {
+            texels.push_back(glm::vec4(s.center, s.radius));
+            texels.push_back(glm::vec4(s.color, float(s.reflectType)));
+            texels.push_back(glm::vec4(s.emission, 0.0f));
+        }
+        return texels;
+    }
+
+    // The smallpt-style Cornell box render.frag used to hard-code (scenes/cornell_box.scene).
+    static Scene cornellBox() {
+        Scene scene;
+        scene.spheres = {
+                {1e6f, {1e6f + 1.0f, 40.8f, 81.6f}, {0.75f, 0.25f, 0.25f}, glm::vec3(0.0f), DIFFUSE},
+                {1e6f, {-1e6f + 99.0f, 40.8f, 81.6f}, {0.25f, 0.25f, 0.75f}, glm::vec3(0.0f), DIFFUSE},
+                {1e6f, {50.0f, 40.8f, 1e6f}, {0.75f, 0.75f, 0.75f}, glm::vec3(0.0f), DIFFUSE},
+                {1e6f, {50.0f, 40.8f, -1e6f + 250.0f}, glm::vec3(0.0f), glm::vec3(0.0f), DIFFUSE},
+                {1e6f, {50.0f, 1e6f, 81.6f}, {0.75f, 0.75f, 0.75f}, glm::vec3(0.0f), DIFFUSE},
+                {1e6f, {50.0f, -1e6f + 81.6f, 81.6f}, {0.75f, 0.75f, 0.75f}, glm::vec3(0.0f), DIFFUSE},
+                {15.0f, {50.0f, 90.0f, 81.6f}, glm::vec3(0.0f), {36.0f, 36.0f, 36.0f}, DIFFUSE},
+                {20.0f, {65.0f, 20.0f, 20.0f}, {0.25f, 0.75f, 0.25f}, glm::vec3(0.0f), DIFFUSE},
+                {16.5f, {27.0f, 16.5f, 47.0f}, {0.99f, 0.99f, 0.99f}, glm::vec3(0.0f), SPECULAR},
+                {16.5f, {77.0f, 16.5f, 78.0f}, {0.99f, 0.99f, 0.99f}, glm::vec3(0.0f), SPECULAR},
+        };
+        return scene;
+    }
+};
+
+#endif //SCENE_H
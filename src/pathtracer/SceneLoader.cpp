@@ -0,0 +1,95 @@
+#include "SceneLoader.h"
+#include "mesh/TriMeshLoader.h"
+
+static glm::vec3 readVec3(istringstream &line) {
+    glm::vec3 v;
+    line >> v.x >> v.y >> v.z;
+    return v;
+}
+
+static bool readReflectionType(istringstream &line, ReflectionType &reflectType) {
+    string type;
+    line >> type;
+    if (type == "diffuse") {
+        reflectType = DIFFUSE;
+    } else if (type == "specular") {
+        reflectType = SPECULAR;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+Scene SceneLoader::load(const string &filepath) {
+    ifstream file(filepath);
+    if (file.fail()) {
+        fprintf(stderr, "Scene file \"%s\" does not exist.\n", filepath.c_str());
+        exit(1);
+    }
+
+    Scene scene;
+    string buffer;
+    int lineNumber = 0;
+    while (getline(file, buffer)) {
+        lineNumber++;
+        istringstream line(buffer.substr(0, buffer.find('#')));
+        string keyword;
+        if (!(line >> keyword)) {
+            continue;
+        }
+        if (keyword == "camera") {
+            scene.camera.position = readVec3(line);
+            scene.camera.dir = glm::normalize(readVec3(line));
+            scene.camera.up = readVec3(line);
+            line >> scene.camera.screenDist >> scene.camera.screenHeight;
+        } else if (keyword == "sphere") {
+            Sphere sphere;
+            line >> sphere.radius;
+            sphere.center = readVec3(line);
+            sphere.color = readVec3(line);
+            sphere.emission = readVec3(line);
+            if (!readReflectionType(line, sphere.reflectType)) {
+                fprintf(stderr, "%s:%d: unknown material (expected diffuse or specular)\n", filepath.c_str(), lineNumber);
+                exit(1);
+            }
+            scene.spheres.push_back(sphere);
+        } else if (keyword == "mesh") {
+            if (scene.mesh) {
+                fprintf(stderr, "%s:%d: only one mesh is supported\n", filepath.c_str(), lineNumber);
+                exit(1);
+            }
+            string meshPath;
+            float size;
+            Material material;
+            line >> meshPath;
+            glm::vec3 base = readVec3(line);
+            line >> size;
+            material.color = readVec3(line);
+            material.emission = readVec3(line);
+            if (!readReflectionType(line, material.reflectType)) {
+                fprintf(stderr, "%s:%d: unknown material (expected diffuse or specular)\n", filepath.c_str(), lineNumber);
+                exit(1);
+            }
+            if (fs::path(meshPath).is_relative()) {
+                meshPath = (fs::path(filepath).parent_path() / meshPath).string();
+            }
+            TriMeshLoader meshLoader;
+            meshLoader.derived = 0;
+            BVH bvh;
+            TriMesh mesh = meshLoader.load(meshPath, &bvh);
+            scene.mesh = make_shared<MeshObject>(mesh, base, size, material, &bvh);
+        } else {
+            fprintf(stderr, "%s:%d: unknown keyword \"%s\"\n", filepath.c_str(), lineNumber, keyword.c_str());
+            exit(1);
+        }
+        if (line.fail()) {
+            fprintf(stderr, "%s:%d: can't be read by our simple parser\n", filepath.c_str(), lineNumber);
+            exit(1);
+        }
+    }
+    cout << "total spheres : " << scene.spheres.size() << endl;
+    if (scene.mesh) {
+        cout << "mesh faces : " << scene.mesh->mesh.faceN << endl;
+    }
+    return scene;
+}
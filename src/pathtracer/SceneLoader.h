@@ -0,0 +1,27 @@
+#pragma once
+
+#ifndef SCENE_LOADER
+#define SCENE_LOADER
+
+#include "Scene.h"
+#include "core/common.h"
+
+// Reads the text scene description used by both path tracer backends:
+//
+//   # comment
+//   camera <position> <direction> <up> <screen distance> <screen height>
+//   sphere <radius> <center> <color> <emission> <diffuse|specular>
+//   mesh <obj/ply/stl file> <base> <size> <color> <emission> <diffuse|specular>
+//
+// Vectors are three whitespace separated numbers. Refraction is not implemented by either
+// backend yet and is rejected. Any number of spheres and at most one mesh
+// may be given. The mesh is scaled so that the longest side of its bounding box is size and
+// placed with the bottom center of that box at base; its path is relative to the scene file.
+class SceneLoader {
+public:
+    SceneLoader() = default;
+
+    Scene load(const string &filepath);
+};
+
+#endif //SCENE_LOADER
@@ -0,0 +1,12 @@
+#version 330
+precision highp float;
+
+out vec4 out_color;
+
+// rgb = sum of radiance, a = number of samples.
+uniform sampler2D accumulation;
+
+void main(void){
+    vec4 sum = texelFetch(accumulation, ivec2(gl_FragCoord.xy), 0);
+    out_color = vec4(sum.rgb / max(sum.a, 1.0), 1.0);
+}
@@ -0,0 +1,22 @@
+#version 410
+precision highp float;
+
+in vec3 v_position;
+in vec3 v_normal;
+
+out vec4 out_color;
+
+uniform float u_lightPower;
+uniform vec3 u_materialColor;
+// Set by VertexArrayObjectForMesh::draw() for FLAT_SHADING: the normal of the triangle
+// replaces the interpolated one, so the indexed buffers serve both shading methods.
+uniform bool u_flatShading;
+
+void main(void) {
+    vec3 n = u_flatShading ? normalize(cross(dFdx(v_position), dFdy(v_position))) : normalize(v_normal);
+    // Point light at the camera, lighting both sides of the surface.
+    vec3 toLight = -v_position;
+    float distance2 = max(dot(toLight, toLight), 1e-12);
+    float cosine = abs(dot(n, toLight)) / sqrt(distance2);
+    out_color = vec4(u_materialColor * min(u_lightPower * cosine / distance2, 1.0), 1.0);
+}
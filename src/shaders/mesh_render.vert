@@ -0,0 +1,21 @@
+#version 410
+precision highp float;
+
+// Mesh drawn by VertexArrayObjectForMesh: positions at location 0, vertex normals at location 1.
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_normal;
+
+uniform mat4 u_mvpMat;
+uniform mat4 u_modelMat;
+uniform mat4 u_viewMat;
+
+// View space, where the light sits at the camera.
+out vec3 v_position;
+out vec3 v_normal;
+
+void main(void) {
+    mat4 mvMat = u_viewMat * u_modelMat;
+    v_position = (mvMat * vec4(in_position, 1.0)).xyz;
+    v_normal = mat3(mvMat) * in_normal;
+    gl_Position = u_mvpMat * vec4(in_position, 1.0);
+}
@@ -0,0 +1,25 @@
+#version 410
+precision highp float;
+
+in vec3 v_position;
+in vec3 v_normal;
+
+out vec4 out_color;
+
+uniform vec3 u_materialColor;
+// See mesh_render.frag.
+uniform bool u_flatShading;
+
+// Gooch et al. 1998: cool to warm by the cosine to a light at the camera.
+const vec3 COOL = vec3(0.0, 0.0, 0.55);
+const vec3 WARM = vec3(0.3, 0.3, 0.0);
+const float ALPHA = 0.25;
+const float BETA = 0.5;
+
+void main(void) {
+    vec3 n = u_flatShading ? normalize(cross(dFdx(v_position), dFdy(v_position))) : normalize(v_normal);
+    float cosine = abs(dot(n, normalize(-v_position)));
+    vec3 kCool = COOL + ALPHA * u_materialColor;
+    vec3 kWarm = WARM + BETA * u_materialColor;
+    out_color = vec4(mix(kCool, kWarm, cosine), 1.0);
+}
@@ -8,15 +8,58 @@ precision highp float;
 #define REFRACTION 2
 #define DEPTH_MAX 100
 #define DEPTH_MIN 30
+#define MESH_EPS 1e-3
+// BVH::MAX_DEPTH; PathTracer::setScene() refuses deeper trees, so the stack never overflows.
+#define MESH_STACK_SIZE 64
 const float PI = acos(-1.0);
 const uint UINT_MAX = 4294967295U;
 
 uniform vec2 resolution;
 uniform vec2 mouse;
+// Index of the first sample computed by this pass; the pass computes samplesPerPass samples.
 uniform int frame;
-uniform int numSamples;
+uniform int samplesPerPass;
 
-out vec4 out_color;
+// Adaptive sampling: tiles of tileSize x tileSize pixels marked in convergenceMap get no more samples.
+uniform sampler2D convergenceMap;
+uniform int tileSize;
+
+// Accumulated with additive blending: (sum of radiance, sample count) and (sum L, sum L^2, sample count, 0).
+layout(location = 0) out vec4 out_color;
+layout(location = 1) out vec4 out_moment;
+// Denoiser AOVs, written when writeAovs is set: (sum of first-hit albedo / normal, sample count).
+layout(location = 2) out vec4 out_albedo;
+layout(location = 3) out vec4 out_normal;
+uniform int writeAovs;
+
+const vec3 LUMINANCE = vec3(0.2126, 0.7152, 0.0722);
+
+// Scene uploaded by PathTracer::setScene(), three texels per sphere (see Scene::packSpheres()).
+uniform samplerBuffer spheres;
+uniform int numSpheres;
+
+// Optional triangle mesh; its objectId is numSpheres. Two texels per BVH node and three per
+// triangle in BVH leaf order, see MeshObject::packNodes() and MeshObject::packTriangles().
+uniform usamplerBuffer meshNodes;
+uniform samplerBuffer meshTriangles;
+uniform int hasMesh;
+uniform vec3 meshColor;
+uniform vec3 meshEmission;
+uniform int meshReflectType;
+
+// Sample generator, see pathtracer/Sampler.h: 0 = xorshift, 1 = Owen-scrambled Sobol,
+// 2 = Owen-scrambled Sobol rotated by the blue-noise mask.
+uniform int samplerType;
+// Selects an independent set of sequences, 0 gives the default ones.
+uniform uint seed;
+uniform sampler2D blueNoise;
+uniform int blueNoiseSize;
+
+uniform vec3 cameraPosition;
+uniform vec3 cameraDir;
+uniform vec3 cameraUp;
+uniform float screenDist;
+uniform float screenHeight;
 
 float pixSize = 1.0;
 float gamma = 2.2;
@@ -29,8 +72,10 @@ struct Sphere {
     int reflectType;
 };
 
-struct Scene{
-    Sphere s[10];
+struct Material {
+    vec3 color;
+    vec3 emission;
+    int reflectType;
 };
 
 struct Ray{
@@ -64,7 +109,102 @@ uint rand(){
 
 float rand01(){
     //return noise1(float(rand()) / float(UINT_MAX)) / 2.0 + 0.5;
-    return float(rand()) / float(UINT_MAX);
+    return float(rand() >> 8U) * (1.0 / 16777216.0);
+}
+
+uint hashUint(uint x){
+    x ^= x >> 16U;
+    x *= 0x7feb352dU;
+    x ^= x >> 15U;
+    x *= 0x846ca68bU;
+    x ^= x >> 16U;
+    return x;
+}
+
+// Direction numbers of the first three Sobol dimensions, same as SOBOL_DIRECTIONS in Sampler.h.
+const uint SOBOL_DIRECTIONS[96] = uint[](
+    0x80000000U, 0x40000000U, 0x20000000U, 0x10000000U, 0x08000000U, 0x04000000U, 0x02000000U, 0x01000000U,
+    0x00800000U, 0x00400000U, 0x00200000U, 0x00100000U, 0x00080000U, 0x00040000U, 0x00020000U, 0x00010000U,
+    0x00008000U, 0x00004000U, 0x00002000U, 0x00001000U, 0x00000800U, 0x00000400U, 0x00000200U, 0x00000100U,
+    0x00000080U, 0x00000040U, 0x00000020U, 0x00000010U, 0x00000008U, 0x00000004U, 0x00000002U, 0x00000001U,
+    0x80000000U, 0xc0000000U, 0xa0000000U, 0xf0000000U, 0x88000000U, 0xcc000000U, 0xaa000000U, 0xff000000U,
+    0x80800000U, 0xc0c00000U, 0xa0a00000U, 0xf0f00000U, 0x88880000U, 0xcccc0000U, 0xaaaa0000U, 0xffff0000U,
+    0x80008000U, 0xc000c000U, 0xa000a000U, 0xf000f000U, 0x88008800U, 0xcc00cc00U, 0xaa00aa00U, 0xff00ff00U,
+    0x80808080U, 0xc0c0c0c0U, 0xa0a0a0a0U, 0xf0f0f0f0U, 0x88888888U, 0xccccccccU, 0xaaaaaaaaU, 0xffffffffU,
+    0x80000000U, 0xc0000000U, 0x60000000U, 0x90000000U, 0xe8000000U, 0x5c000000U, 0x8e000000U, 0xc5000000U,
+    0x68800000U, 0x9cc00000U, 0xee600000U, 0x55900000U, 0x80680000U, 0xc09c0000U, 0x60ee0000U, 0x90550000U,
+    0xe8808000U, 0x5cc0c000U, 0x8e606000U, 0xc5909000U, 0x6868e800U, 0x9c9c5c00U, 0xeeee8e00U, 0x5555c500U,
+    0x8000e880U, 0xc0005cc0U, 0x60008e60U, 0x9000c590U, 0xe8006868U, 0x5c009c9cU, 0x8e00eeeeU, 0xc5005555U
+);
+
+uint sobol(uint index, int dim){
+    uint x = 0U;
+    for (int bit = 0; index != 0U; bit++, index >>= 1U){
+        if ((index & 1U) != 0U){
+            x ^= SOBOL_DIRECTIONS[32 * dim + bit];
+        }
+    }
+    return x;
+}
+
+uint hashCombine(uint seed, uint v){
+    return seed ^ (v + (seed << 6U) + (seed >> 2U));
+}
+
+uint nestedUniformScramble(uint x, uint seed){
+    x = bitfieldReverse(x);
+    x += seed;
+    x ^= x * 0x6c50b47cU;
+    x ^= x * 0xb82f1e52U;
+    x ^= x * 0xc7afe638U;
+    x ^= x * 0x8d22f6e6U;
+    return bitfieldReverse(x);
+}
+
+float toUnitFloat(uint x){
+    return float(x >> 8U) * (1.0 / 16777216.0);
+}
+
+vec3 sobolOwen(uint index, uint seed){
+    uint shuffledIndex = nestedUniformScramble(index, hashCombine(seed, 0U));
+    vec3 u;
+    for (int dim = 0; dim < 3; dim++){
+        u[dim] = toUnitFloat(nestedUniformScramble(sobol(shuffledIndex, dim), hashCombine(seed, uint(dim + 1))));
+    }
+    return u;
+}
+
+// Sample stream of the current path, mirrors PathSampler in Sampler.h.
+uint seedOffset_;
+uint pixelSeed_;
+uint sampleIndex_;
+uint bounce_;
+
+void initSampler(int sampleIndex){
+    uint pixel = uint(gl_FragCoord.y) * uint(resolution.x) + uint(gl_FragCoord.x);
+    seedOffset_ = seed * 0x9e3779b9U;
+    pixelSeed_ = hashUint(pixel) ^ seedOffset_;
+    sampleIndex_ = uint(sampleIndex);
+    bounce_ = 0U;
+    initSeeds(hashUint(pixel + hashUint(sampleIndex_)) ^ seedOffset_);
+}
+
+vec3 nextSample(){
+    uint b = bounce_++;
+    if (samplerType == 1){
+        return sobolOwen(sampleIndex_, hashCombine(pixelSeed_, b));
+    }
+    if (samplerType == 2){
+        vec3 u = sobolOwen(sampleIndex_, hashUint(b) ^ seedOffset_);
+        for (int dim = 0; dim < 3; dim++){
+            uint shift = hashUint(3U * b + uint(dim));
+            ivec2 p = (ivec2(gl_FragCoord.xy) + ivec2(shift & 0xffffU, shift >> 16U)) & (blueNoiseSize - 1);
+            float r = u[dim] + texelFetch(blueNoise, p, 0).r;
+            u[dim] = r >= 1.0 ? r - 1.0 : r;
+        }
+        return u;
+    }
+    return vec3(rand01(), rand01(), rand01());
 }
 
     #define HASHSCALE3 vec3(.1031, .1030, .0973)
@@ -153,13 +293,138 @@ bool intersectSphere(Ray r, Sphere s, inout Hitpoint hp){
 }
 
 
-bool intersectScene(Ray r, Scene scene, inout Hitpoint hp){
+Sphere fetchSphere(int i){
+    vec4 t0 = texelFetch(spheres, 3 * i + 0);
+    vec4 t1 = texelFetch(spheres, 3 * i + 1);
+    vec4 t2 = texelFetch(spheres, 3 * i + 2);
+    return Sphere(t0.w, t0.xyz, t1.rgb, t2.rgb, int(t1.w));
+}
+
+// Entry distance into the box of node i, or INF if the ray misses it within (tMin, tMax).
+float intersectNode(int i, vec3 org, vec3 invDir, float tMin, float tMax){
+    vec3 t0 = (uintBitsToFloat(texelFetch(meshNodes, 2 * i + 0).xyz) - org) * invDir;
+    vec3 t1 = (uintBitsToFloat(texelFetch(meshNodes, 2 * i + 1).xyz) - org) * invDir;
+    vec3 tNear = min(t0, t1);
+    vec3 tFar = max(t0, t1);
+    float enter = max(max(tNear.x, tNear.y), max(tNear.z, tMin));
+    float exit = min(min(tFar.x, tFar.y), min(tFar.z, tMax));
+    return enter <= exit ? enter : INF;
+}
+
+// Watertight ray/triangle test (Woop et al. 2013), same as WatertightRay in mesh/BVH.cpp.
+bool intersectTriangle(vec3 org, ivec3 k, vec3 S, vec3 v0, vec3 v1, vec3 v2, float tMax, out float t){
+    vec3 A = v0 - org;
+    vec3 B = v1 - org;
+    vec3 C = v2 - org;
+    float Ax = A[k.x] - S.x * A[k.z];
+    float Ay = A[k.y] - S.y * A[k.z];
+    float Bx = B[k.x] - S.x * B[k.z];
+    float By = B[k.y] - S.y * B[k.z];
+    float Cx = C[k.x] - S.x * C[k.z];
+    float Cy = C[k.y] - S.y * C[k.z];
+    float U = Cx * By - Cy * Bx;
+    float V = Ax * Cy - Ay * Cx;
+    float W = Bx * Ay - By * Ax;
+    t = INF;
+    if ((U < 0.0 || V < 0.0 || W < 0.0) && (U > 0.0 || V > 0.0 || W > 0.0)){
+        return false;
+    }
+    float det = U + V + W;
+    if (det == 0.0){
+        return false;
+    }
+    t = (U * S.z * A[k.z] + V * S.z * B[k.z] + W * S.z * C[k.z]) / det;
+    return t > MESH_EPS && t < tMax;
+}
+
+// Closest triangle closer than hp.dist, found with a stack-based BVH traversal.
+bool intersectMesh(Ray r, inout Hitpoint hp){
+    vec3 invDir = 1.0 / r.dir;
+    if (intersectNode(0, r.org, invDir, MESH_EPS, hp.dist) == INF){
+        return false;
+    }
+    // Shear constants of the watertight test.
+    vec3 a = abs(r.dir);
+    int kz = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+    int kx = (kz + 1) % 3;
+    int ky = (kx + 1) % 3;
+    if (r.dir[kz] < 0.0){
+        int tmp = kx;
+        kx = ky;
+        ky = tmp;
+    }
+    ivec3 k = ivec3(kx, ky, kz);
+    vec3 S = vec3(r.dir[kx] / r.dir[kz], r.dir[ky] / r.dir[kz], 1.0 / r.dir[kz]);
+
+    int stack[MESH_STACK_SIZE];
+    int stackSize = 0;
+    int node = 0;
+    int hitTriangle = -1;
+    for (;;){
+        int leftFirst = int(texelFetch(meshNodes, 2 * node + 0).w);
+        int triCount = int(texelFetch(meshNodes, 2 * node + 1).w);
+        if (triCount > 0){
+            int first = leftFirst;
+            for (int i = first; i < first + triCount; i++){
+                float t;
+                if (intersectTriangle(r.org, k, S, texelFetch(meshTriangles, 3 * i + 0).xyz,
+                texelFetch(meshTriangles, 3 * i + 1).xyz, texelFetch(meshTriangles, 3 * i + 2).xyz, hp.dist, t)){
+                    hp.dist = t;
+                    hitTriangle = i;
+                }
+            }
+        } else {
+            int nearChild = leftFirst;
+            int farChild = nearChild + 1;
+            float dNear = intersectNode(nearChild, r.org, invDir, MESH_EPS, hp.dist);
+            float dFar = intersectNode(farChild, r.org, invDir, MESH_EPS, hp.dist);
+            if (dFar < dNear){
+                int tmp = nearChild;
+                nearChild = farChild;
+                farChild = tmp;
+                float tmpDist = dNear;
+                dNear = dFar;
+                dFar = tmpDist;
+            }
+            if (dNear != INF){
+                if (dFar != INF){
+                    stack[stackSize++] = farChild;
+                }
+                node = nearChild;
+                continue;
+            }
+        }
+        if (stackSize == 0){
+            break;
+        }
+        node = stack[--stackSize];
+    }
+    if (hitTriangle < 0){
+        return false;
+    }
+    vec3 v0 = texelFetch(meshTriangles, 3 * hitTriangle + 0).xyz;
+    vec3 v1 = texelFetch(meshTriangles, 3 * hitTriangle + 1).xyz;
+    vec3 v2 = texelFetch(meshTriangles, 3 * hitTriangle + 2).xyz;
+    hp.pos = r.org + hp.dist * r.dir;
+    hp.normal = normalize(cross(v1 - v0, v2 - v0));
+    return true;
+}
+
+Material fetchMaterial(int objectId){
+    if (objectId == numSpheres){
+        return Material(meshColor, meshEmission, meshReflectType);
+    }
+    Sphere s = fetchSphere(objectId);
+    return Material(s.color, s.emission, s.reflectType);
+}
+
+bool intersectScene(Ray r, inout Hitpoint hp){
     hp.dist = INF;
     hp.objectId = -1;
-    for (int i = 0;i < 10; i++){
+    for (int i = 0;i < numSpheres; i++){
         Hitpoint tmp;
         tmp.objectId = i;
-        if (intersectSphere2(r, scene.s[i], tmp)){
+        if (intersectSphere2(r, fetchSphere(i), tmp)){
             if (tmp.dist < hp.dist){
                 hp.pos = tmp.pos;
                 hp.normal = tmp.normal;
@@ -168,26 +433,29 @@ bool intersectScene(Ray r, Scene scene, inout Hitpoint hp){
             }
         }
     }
+    if (hasMesh != 0 && intersectMesh(r, hp)){
+        hp.objectId = numSpheres;
+    }
     return (hp.objectId != -1);
 }
 
 
 
 
-vec3 radiance(Ray ray, Scene scene){
+vec3 radiance(Ray ray, int sampleIndex){
+    initSampler(sampleIndex);
     vec3 accumulatedColor = vec3(0.0);
     vec3 accumulatedReflectance = vec3(1.0);
     int depth = 0;
     Ray nowRay = ray;
     for (;;depth++){
         Hitpoint hp;
-        if (!intersectScene(nowRay, scene, hp)){
+        if (!intersectScene(nowRay, hp)){
             return accumulatedColor;
         }
-        Sphere obj = scene.s[hp.objectId];
+        Material obj = fetchMaterial(hp.objectId);
         vec3 orientingNormal = (dot(hp.normal, nowRay.dir) < 0.0 ? hp.normal: (-1.0 * hp.normal));
-        vec3 seed = vec3(gl_FragCoord.xy, float(frame) * 0.3) + float(depth) * 500.0 + 50.0;
-        vec3 Xi = hash33(seed);
+        vec3 Xi = nextSample();
         accumulatedColor += accumulatedReflectance * obj.emission;
 
         float rrp = max(obj.color.x, max(obj.color.y, obj.color.z));//roussian roulette probability
@@ -235,26 +503,9 @@ float random (vec2 st) {
 }
 
 void main(){
-    uint seed = uint(gl_FragCoord.x * gl_FragCoord.y * gl_FragCoord.y * frame + 1.0);
-    //float hoge = noise1(0);
-    //uint seed = uint(random(gl_FragCoord.xy) * float(UINT_MAX));
-    initSeeds(seed);
-    Scene scene;
-    scene.s[0] = Sphere(1e6, vec3(1e6+1.0, 40.8, 81.6), vec3(0.75, 0.25, 0.25), vec3(0.0), DIFFUSE);
-    scene.s[1] = Sphere(1e6, vec3(-1e6+99.0, 40.8, 81.6), vec3(0.25, 0.25, 0.75), vec3(0.0), DIFFUSE);
-    scene.s[2] = Sphere(1e6, vec3(50, 40.8, 1e6), vec3(0.75, 0.75, 0.75), vec3(0.0), DIFFUSE);
-    scene.s[3] = Sphere(1e6, vec3(50, 40.8, -1e6+250.0), vec3(0.0), vec3(0.0), DIFFUSE);
-    scene.s[4] = Sphere(1e6, vec3(50, 1e6, 81.6), vec3(0.75, 0.75, 0.75), vec3(0.0), DIFFUSE);
-    scene.s[5] = Sphere(1e6, vec3(50, -1e6+81.6, 81.6), vec3(0.75, 0.75, 0.75), vec3(0.0), DIFFUSE);
-    scene.s[6] = Sphere(15.0, vec3(50.0, 90.0, 81.6), vec3(0.0), vec3(36.0, 36.0, 36.0), DIFFUSE);
-    scene.s[7] = Sphere(20.0, vec3(65.0, 20.0, 20.0), vec3(0.25, 0.75, 0.25), vec3(0.0), DIFFUSE);
-    scene.s[8] = Sphere(16.5, vec3(27.0, 16.5, 47.0), vec3(0.99, 0.99, 0.99), vec3(0.0), SPECULAR),
-    scene.s[9] = Sphere(16.5, vec3(77.0, 16.5, 78.0), vec3(0.99, 0.99, 0.99), vec3(0.0), SPECULAR);
-    const vec3 cameraPosition = vec3(50.0, 52.0, 220.0);
-    const vec3 cameraDir      = normalize(vec3(0.0, -0.04, -1.0));
-    const vec3 cameraUp = vec3(0.0, 1.0, 0.0);
-    float screenDist = 40.0;
-    float screenHeight = 30.0;
+    if (texelFetch(convergenceMap, ivec2(gl_FragCoord.xy) / tileSize, 0).r > 0.5) {
+        discard;
+    }
     float screenWidth = screenHeight * resolution.x / resolution.y;
     vec3 screenX = normalize(cross(cameraDir, cameraUp));
     vec3 screenY = normalize(cross(screenX, cameraDir));
@@ -264,6 +515,7 @@ void main(){
     //vec3 pixPos = vec3((gl_FragCoord.xy - resolution / 2.0) * pixSize, 0.0) + screenCenter;
     vec3 pixPos = screenX * (gl_FragCoord.x / resolution.x - 0.5) * screenWidth + screenY * (gl_FragCoord.y / resolution.y - 0.5) * screenHeight + screenCenter;
     vec3 sumRadiance = vec3(0.0);
+    vec2 sumMoment = vec2(0.0);
     //	for(int sx = 1; sx <= 4; sx++){
     //		for(int sy = 1; sy <= 4; sy++){
     //			vec3 spixPos = pixPos + pixSize / 4.0 * (screenX + screenY);
@@ -271,14 +523,31 @@ void main(){
     //			sumRadiance += radiance(ray, scene) / float(numSamples * 4 * 4);
     //		}
     //	}
-    int n = 1;
+    int n = samplesPerPass;
     for (int i=0;i < n;i++){
         vec3 pos = pixPos + pixSize / 2.0 * (screenX + screenY);
         Ray ray = Ray(cameraPosition, normalize(pos - cameraPosition));
-        sumRadiance += radiance(ray, scene) / float(numSamples);
+        vec3 L = radiance(ray, frame + i);
+        float lum = dot(L, LUMINANCE);
+        sumRadiance += L;
+        sumMoment += vec2(lum, lum * lum);
         //sumRadiance = max(sumRadiance, radiance(ray, scene));
     }
-    out_color = vec4(sumRadiance, 1.0);
+    out_color = vec4(sumRadiance, float(n));
+    out_moment = vec4(sumMoment, float(n), 0.0);
+    out_albedo = vec4(0.0);
+    out_normal = vec4(0.0);
+    if (writeAovs != 0){
+        // Camera rays are not jittered, so the first hit is the same for every sample.
+        vec3 pos = pixPos + pixSize / 2.0 * (screenX + screenY);
+        Ray ray = Ray(cameraPosition, normalize(pos - cameraPosition));
+        Hitpoint hp;
+        if (intersectScene(ray, hp)){
+            vec3 normal = dot(hp.normal, ray.dir) < 0.0 ? hp.normal : -hp.normal;
+            out_albedo = vec4(fetchMaterial(hp.objectId).color * float(n), float(n));
+            out_normal = vec4(normal * float(n), float(n));
+        }
+    }
     return;
     out_color = vec4(gammaCorrection(clamp(sumRadiance, 0.0, 1.0)), 1.0);
     return;
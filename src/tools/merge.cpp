@@ -0,0 +1,73 @@
+#include "core/common.h"
+#include "core/Image.h"
+#include "pathtracer/PartialAccumulation.h"
+
+// Sums partial accumulations written with --partial into one image:
+//
+//   renderer_merge [--partial MERGED.part] OUTPUT PARTIAL...
+//
+// OUTPUT gets the averaged radiance (.png/.bmp/.tga/.jpg/.hdr). With --partial the sum is
+// also written as a partial again, so merging can be done in stages.
+int main(int argc, char **argv) {
+    string mergedPath;
+    vector<string> paths;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--partial" && i + 1 < argc) {
+            mergedPath = argv[++i];
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.size() < 2) {
+        fprintf(stderr, "usage: %s [--partial MERGED.part] OUTPUT PARTIAL...\n", argv[0]);
+        exit(1);
+    }
+    const string output = paths[0];
+    paths.erase(paths.begin());
+
+    vector<PartialAccumulation> partials(paths.size());
+    for (size_t i = 0; i < paths.size(); i++) {
+        partials[i].load(paths[i]);
+    }
+    // Partials of the same seed must cover disjoint sample ranges, otherwise samples would be
+    // counted twice.
+    vector<size_t> order(partials.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (partials[a].seed != partials[b].seed) {
+            return partials[a].seed < partials[b].seed;
+        }
+        return partials[a].sampleBegin < partials[b].sampleBegin;
+    });
+    for (size_t i = 1; i < order.size(); i++) {
+        const PartialAccumulation &prev = partials[order[i - 1]], &next = partials[order[i]];
+        if (prev.seed == next.seed && next.sampleBegin < prev.sampleEnd) {
+            fprintf(stderr, "%s [%d, %d) and %s [%d, %d) overlap (seed %u).\n",
+                    paths[order[i - 1]].c_str(), prev.sampleBegin, prev.sampleEnd,
+                    paths[order[i]].c_str(), next.sampleBegin, next.sampleEnd, next.seed);
+            exit(1);
+        }
+    }
+
+    PartialAccumulation merged = partials[order[0]];
+    for (size_t i = 1; i < order.size(); i++) {
+        merged.add(partials[order[i]]);
+    }
+    double samples = 0.0;
+    for (const glm::vec4 &a : merged.accumulation) {
+        samples += a.w;
+    }
+    printf("Merged %d partials (%.1f spp avg)\n", int(partials.size()),
+           samples / (double(merged.width) * merged.height));
+
+    if (!mergedPath.empty()) {
+        merged.save(mergedPath);
+    }
+    if (!writeImage(output, merged.image(), merged.width, merged.height)) {
+        exit(1);
+    }
+    return 0;
+}